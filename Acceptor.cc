@@ -1,13 +1,20 @@
 #include "Acceptor.h"
 #include "Logger.h"
 #include "InetAddress.h"
+#include "EventLoop.h"
 
 #include <sys/types.h>         
 #include <sys/socket.h>
 #include <unistd.h>
 #include <errno.h>
+#include <strings.h>
 
 
+// ET模式下每次事件最多accept的连接数
+static const int kMaxAcceptsPerEvent = 64;
+// ET模式下fd等资源用完时隔多久再accept
+static const double kAcceptRetrySeconds = 0.1;
+
 static int createNonblocking()
 {
         int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
@@ -15,6 +22,7 @@ static int createNonblocking()
         {
                 LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
         }
+        return sockfd;
 }
 
 Acceptor::Acceptor(EventLoop* loop, const InetAddress& listenAddr, bool reuseport)
@@ -22,19 +30,40 @@ Acceptor::Acceptor(EventLoop* loop, const InetAddress& listenAddr, bool reusepor
         , acceptSocket_(createNonblocking())
         , acceptChannel_(loop, acceptSocket_.fd())
         , listenning_(false)
+        , acceptErrno_(0)
+        , self_(std::make_shared<Acceptor*>(this))
 {
         acceptSocket_.setReuseAddr(true);
-        acceptSocket_.setReusePort(true);
+        acceptSocket_.setReusePort(reuseport);
         acceptSocket_.bindAddress(listenAddr);
         // TcpServer::start() -> Acceptor::listen() -> Channel::enableReading() -> Channel::update()
         // baseLoop => acceptChannel_(listenfd) =>
         acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+        acceptChannel_.setCompletionCallback(Channel::kAcceptCompletion,
+                std::bind(&Acceptor::handleAcceptCompletion, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+Acceptor::Acceptor(EventLoop* loop, int listenfd)
+        : loop_(loop)
+        , acceptSocket_(listenfd)
+        , acceptChannel_(loop, listenfd)
+        , listenning_(false)
+        , acceptErrno_(0)
+        , self_(std::make_shared<Acceptor*>(this))
+{
+        acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+        acceptChannel_.setCompletionCallback(Channel::kAcceptCompletion,
+                std::bind(&Acceptor::handleAcceptCompletion, this, std::placeholders::_1, std::placeholders::_2));
 }
 
 Acceptor::~Acceptor()
 {
         acceptChannel_.disableAll();
         acceptChannel_.remove();
+        for (int connfd : acceptedFds_)
+        {
+                ::close(connfd);
+        }
 }
 
 void Acceptor::listen()
@@ -45,27 +74,125 @@ void Acceptor::listen()
 }
 
 // listenfd有事件发生了， 就是有新用户连接了
+// LT模式下每次事件accept一次 ET模式下一直accept到EAGAIN 每次事件最多kMaxAcceptsPerEvent个
 void Acceptor::handleRead()
 {
-        InetAddress peerAddr;
-        int connfd = acceptSocket_.accept(&peerAddr);
-        if (connfd >= 0)
+        if (!acceptedFds_.empty() || acceptErrno_ != 0)
+        {
+                handleAccepted(); // poller已经替我们accept了
+                return;
+        }
+
+        const int maxAccepts = acceptChannel_.isEdgeTriggered() ? kMaxAcceptsPerEvent : 1;
+        for (int accepts = 0; accepts < maxAccepts; ++accepts)
+        {
+                InetAddress peerAddr;
+                int connfd = acceptSocket_.accept(&peerAddr);
+                if (connfd >= 0)
+                {
+                        if (newConnectionCallback_)
+                        {
+                                newConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop，唤醒，粉发当前的新客户端的channel
+                        }
+                        else
+                        {
+                                ::close(connfd);
+                        }
+                }
+                else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                        return;
+                }
+                else if (errno == ECONNABORTED || errno == EPROTO || errno == EINTR)
+                {
+                        // 只和这一个连接有关（比如对端在accept之前就断开了） 继续accept后面的
+                        continue;
+                }
+                else
+                {
+                        int savedErrno = errno;
+                        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+                        if (savedErrno == EMFILE || savedErrno == ENFILE)
+                        {
+                                LOG_ERROR("%s:%s:%d spclfd reached limit !\n", __FILE__, __FUNCTION__, __LINE__);
+                        }
+                        if (acceptChannel_.isEdgeTriggered())
+                        {
+                                // backlog中的连接不会再有边缘通知 fd用完时马上重试只会空转 等一会儿再试
+                                retryAccept(kAcceptRetrySeconds);
+                        }
+                        return;
+                }
+        }
+
+        if (acceptChannel_.isEdgeTriggered())
         {
+                // 达到公平上限 backlog中可能还有连接 不会再有新的边缘通知
+                retryAccept(0.0);
+        }
+}
+
+void Acceptor::retryAccept(double delay)
+{
+        std::weak_ptr<Acceptor*> weak(self_);
+        auto retry = [weak]()
+        {
+                std::shared_ptr<Acceptor*> self = weak.lock();
+                if (self)
+                {
+                        (*self)->handleRead();
+                }
+        };
+        if (delay > 0.0)
+        {
+                loop_->runAfter(delay, retry);
+        }
+        else
+        {
+                loop_->queueNextIteration(retry);
+        }
+}
+
+void Acceptor::handleAcceptCompletion(const char*, int res)
+{
+        if (res >= 0)
+        {
+                acceptedFds_.push_back(res);
+        }
+        else
+        {
+                acceptErrno_ = -res;
+        }
+}
+
+void Acceptor::handleAccepted()
+{
+        for (int connfd : acceptedFds_)
+        {
+                // 多次触发的accept不返回对端地址
+                sockaddr_in addr;
+                socklen_t len = sizeof(addr);
+                bzero(&addr, sizeof(addr));
+                ::getpeername(connfd, reinterpret_cast<sockaddr*>(&addr), &len);
+                InetAddress peerAddr(addr);
                 if (newConnectionCallback_)
                 {
-                        newConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop，唤醒，粉发当前的新客户端的channel
+                        newConnectionCallback_(connfd, peerAddr);
                 }
                 else
                 {
                         ::close(connfd);
                 }
         }
-        else
+        acceptedFds_.clear();
+
+        if (acceptErrno_ != 0)
         {
-                LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
-                if (errno == EMFILE)
+                LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, acceptErrno_);
+                if (acceptErrno_ == EMFILE)
                 {
                         LOG_ERROR("%s:%s:%d spclfd reached limit !\n", __FILE__, __FUNCTION__, __LINE__);
                 }
+                acceptErrno_ = 0;
         }
-}
\ No newline at end of file
+}
@@ -5,6 +5,8 @@
 #include "Channel.h"
 
 #include <functional>
+#include <memory>
+#include <vector>
 class EventLoop;
 class InetAddress;
 
@@ -14,20 +16,40 @@ class Acceptor : noncopyable
 public:
         using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
         Acceptor(EventLoop* loop, const InetAddress& listenAddr, bool reuseport);
+        // 接管一个已经bind过的listenfd（通常是dup出来的） 多个loop共享同一个监听socket时使用
+        Acceptor(EventLoop* loop, int listenfd);
         ~Acceptor();
 
         void setNewConnectionCallback(const NewConnectionCallback& cb)
         { newConnectionCallback_ = cb; }
 
+        // 以EPOLLET监听listenfd 需要在listen之前设置
+        void setEdgeTriggered(bool on) { acceptChannel_.setEdgeTriggered(on); }
+
+        // 以EPOLLEXCLUSIVE监听listenfd 多个loop共享同一个listenfd时每个新连接只唤醒其中一个 需要在listen之前设置
+        void setExclusive(bool on) { acceptChannel_.setExclusive(on); }
+
+        EventLoop* getLoop() const { return loop_; }
+        int fd() const { return acceptSocket_.fd(); }
+
         bool listenning() const { return listenning_; }
         void listen();
 
 private:
         void handleRead();
+        // 完成式accept（io_uring）时poller交来的新连接或者错误
+        void handleAcceptCompletion(const char* data, int res);
+        void handleAccepted();
+        // ET模式下backlog中还有连接但不会再有边缘通知 delay秒后（0表示下一轮）再accept
+        void retryAccept(double delay);
 
-        EventLoop* loop_; // Acceptor用的就是用户定义的那个baseLoop，也称作mainLoop
+        EventLoop* loop_; // 默认是用户定义的那个baseLoop，也称作mainLoop；每个loop各自accept时是subloop
         Socket acceptSocket_;
         Channel acceptChannel_;
         NewConnectionCallback newConnectionCallback_;
         bool listenning_;
+        std::vector<int> acceptedFds_; // poller已经接受、还没交给newConnectionCallback_的连接
+        int acceptErrno_;              // poller报告的accept错误
+        // 登记的重试只持有它的weak_ptr Acceptor销毁后不再执行 销毁和重试都在所属loop线程中
+        std::shared_ptr<Acceptor*> self_;
 };
\ No newline at end of file
@@ -1,7 +1,13 @@
 #pragma once 
 
+#include "SlabPool.h"
+
 #include <vector>
 #include <string>
+#include <endian.h>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
 
 // 网络库底层的缓冲区类型定义
 class Buffer
@@ -16,6 +22,37 @@ public:
                 writerIndex_(kCheapPrepend)
         {}
 
+        // 存储从pool中分配 初始的1KB用malloc 扩容后不超过一个slab时在pool中 再超过之后改用malloc
+        Buffer(SlabPool* pool, size_t initialSize)
+                : buffer_(kCheapPrepend + initialSize, 0, SlabAllocator<char>(pool)),
+                readerIndex_(kCheapPrepend),
+                writerIndex_(kCheapPrepend)
+        {}
+
+        Buffer(const Buffer&) = default;
+        Buffer& operator=(const Buffer&) = default;
+
+        // 接管other的存储 other变成一个空的缓冲区 可以继续使用
+        Buffer(Buffer&& other)
+                : buffer_(std::move(other.buffer_)),
+                readerIndex_(other.readerIndex_),
+                writerIndex_(other.writerIndex_)
+        {
+                other.resetAfterMove();
+        }
+
+        Buffer& operator=(Buffer&& other)
+        {
+                if (this != &other)
+                {
+                        buffer_ = std::move(other.buffer_);
+                        readerIndex_ = other.readerIndex_;
+                        writerIndex_ = other.writerIndex_;
+                        other.resetAfterMove();
+                }
+                return *this;
+        }
+
         size_t readableBytes() const { return writerIndex_ - readerIndex_; }
         size_t writableBytes() const { return buffer_.size() - writerIndex_; }
         size_t prependableBytes() const { return readerIndex_; }
@@ -72,6 +109,36 @@ public:
                 writerIndex_ += len;
         }
 
+        void append(const void* data, size_t len) { append(static_cast<const char*>(data), len); }
+
+        // 整数按网络字节序读写 peek不移动读位置 read读完后retrieve 调用者保证readableBytes()足够
+        void appendInt64(int64_t x) { uint64_t be = htobe64(static_cast<uint64_t>(x)); append(&be, sizeof be); }
+        void appendInt32(int32_t x) { uint32_t be = htobe32(static_cast<uint32_t>(x)); append(&be, sizeof be); }
+        void appendInt16(int16_t x) { uint16_t be = htobe16(static_cast<uint16_t>(x)); append(&be, sizeof be); }
+        void appendInt8(int8_t x) { append(&x, sizeof x); }
+
+        int64_t peekInt64() const { uint64_t be; ::memcpy(&be, peek(), sizeof be); return static_cast<int64_t>(be64toh(be)); }
+        int32_t peekInt32() const { uint32_t be; ::memcpy(&be, peek(), sizeof be); return static_cast<int32_t>(be32toh(be)); }
+        int16_t peekInt16() const { uint16_t be; ::memcpy(&be, peek(), sizeof be); return static_cast<int16_t>(be16toh(be)); }
+        int8_t peekInt8() const { return static_cast<int8_t>(*peek()); }
+
+        int64_t readInt64() { int64_t x = peekInt64(); retrieve(sizeof x); return x; }
+        int32_t readInt32() { int32_t x = peekInt32(); retrieve(sizeof x); return x; }
+        int16_t readInt16() { int16_t x = peekInt16(); retrieve(sizeof x); return x; }
+        int8_t readInt8() { int8_t x = peekInt8(); retrieve(sizeof x); return x; }
+
+        // 写到可读数据的前面 用的是kCheapPrepend预留的空间 调用者保证prependableBytes() >= len
+        // 先append消息体再prepend长度头 不需要搬动消息体
+        void prepend(const void* data, size_t len)
+        {
+                readerIndex_ -= len;
+                ::memcpy(begin() + readerIndex_, data, len);
+        }
+        void prependInt64(int64_t x) { uint64_t be = htobe64(static_cast<uint64_t>(x)); prepend(&be, sizeof be); }
+        void prependInt32(int32_t x) { uint32_t be = htobe32(static_cast<uint32_t>(x)); prepend(&be, sizeof be); }
+        void prependInt16(int16_t x) { uint16_t be = htobe16(static_cast<uint16_t>(x)); prepend(&be, sizeof be); }
+        void prependInt8(int8_t x) { prepend(&x, sizeof x); }
+
         char* beginWrite() { return begin() + writerIndex_; }
 
         const char* beginWrite() const { return begin() + writerIndex_; }
@@ -92,6 +159,13 @@ private:
                 return &*buffer_.begin();
         }
 
+        void resetAfterMove()
+        {
+                buffer_.assign(kCheapPrepend, 0);
+                readerIndex_ = kCheapPrepend;
+                writerIndex_ = kCheapPrepend;
+        }
+
         void makeSpace(size_t len)
         {
                 /*
@@ -113,7 +187,7 @@ private:
                 }
         }
 
-        std::vector<char> buffer_;
+        std::vector<char, SlabAllocator<char>> buffer_;
         size_t readerIndex_;
         size_t writerIndex_;
 };
\ No newline at end of file
@@ -0,0 +1,668 @@
+#include "ChainBuffer.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+const size_t ChainBuffer::kMaxSendfileBytes;
+
+ChainBuffer::ChainBuffer(SlabPool* pool)
+        : head_(nullptr)
+        , tail_(nullptr)
+        , spare_(nullptr)
+        , pool_(pool)
+        , readable_(0)
+        , numSlabs_(0)
+        , zeroCopyNext_(0)
+        , zeroCopyDone_(0)
+        , asyncSends_(0)
+{
+        static_assert(sizeof(Slab) == 48, "kSlabSize assumes a 48-byte slab header");
+        if (pool_ != nullptr)
+        {
+                pool_->retain();
+        }
+}
+
+ChainBuffer::ChainBuffer(ChainBuffer&& other)
+        : head_(other.head_)
+        , tail_(other.tail_)
+        , spare_(other.spare_)
+        , pool_(other.pool_)
+        , readable_(other.readable_)
+        , numSlabs_(other.numSlabs_)
+        , zeroCopyNext_(other.zeroCopyNext_)
+        , zeroCopyDone_(other.zeroCopyDone_)
+        , zeroCopyRanges_(std::move(other.zeroCopyRanges_))
+        , pinned_(std::move(other.pinned_))
+        , asyncSends_(other.asyncSends_)
+{
+        // pool的引用也一起接管
+        other.head_ = nullptr;
+        other.tail_ = nullptr;
+        other.spare_ = nullptr;
+        other.pool_ = nullptr;
+        other.readable_ = 0;
+        other.numSlabs_ = 0;
+        other.zeroCopyDone_ = other.zeroCopyNext_;
+        other.zeroCopyRanges_.clear();
+        other.pinned_.clear();
+        other.asyncSends_ = 0;
+}
+
+ChainBuffer::~ChainBuffer()
+{
+        if (sendPending())
+        {
+                // 内核还可能在发送这些内存 还给pool的slab会被别的连接写入 宁可泄漏
+                // 正常情况下连接会把这样的缓冲区交给loop等完成通知 走到这里说明没有人等
+                size_t leaked = abandon();
+                LOG_ERROR("ChainBuffer::~ChainBuffer send still pending, leak %zu slabs \n", leaked);
+        }
+        while (head_ != nullptr)
+        {
+                Slab* next = head_->next;
+                freeSlab(head_);
+                head_ = next;
+        }
+        if (spare_ != nullptr)
+        {
+                freeSlab(spare_);
+        }
+        for (auto& pinned : pinned_)
+        {
+                freeSlab(pinned.second);
+        }
+        if (pool_ != nullptr)
+        {
+                pool_->release();
+        }
+}
+
+size_t ChainBuffer::abandon()
+{
+        // 文件段不占内存 照常关闭 内存slab连同它们持有的pool引用一起泄漏
+        size_t leaked = 0;
+        while (head_ != nullptr)
+        {
+                Slab* next = head_->next;
+                if (head_->isFile())
+                {
+                        freeSlab(head_);
+                }
+                else
+                {
+                        ++leaked;
+                }
+                head_ = next;
+        }
+        for (auto& pinned : pinned_)
+        {
+                if (pinned.second->isFile())
+                {
+                        freeSlab(pinned.second);
+                }
+                else
+                {
+                        ++leaked;
+                }
+        }
+        tail_ = nullptr;
+        readable_ = 0;
+        numSlabs_ = 0;
+        pinned_.clear();
+        zeroCopyRanges_.clear();
+        zeroCopyDone_ = zeroCopyNext_;
+        asyncSends_ = 0;
+        return leaked;
+}
+
+void ChainBuffer::setPool(SlabPool* pool)
+{
+        if (pool == pool_)
+        {
+                return;
+        }
+        if (pool != nullptr)
+        {
+                pool->retain();
+        }
+        if (pool_ != nullptr)
+        {
+                pool_->release();
+        }
+        pool_ = pool;
+}
+
+ChainBuffer::Slab* ChainBuffer::newSlab(size_t capacity)
+{
+        if (capacity == kSlabSize && spare_ != nullptr)
+        {
+                Slab* slab = spare_;
+                spare_ = nullptr;
+                slab->next = nullptr;
+                slab->readIndex = 0;
+                slab->writeIndex = 0;
+                return slab;
+        }
+        Slab* slab = static_cast<Slab*>(SlabPool::allocate(pool_, sizeof(Slab) + capacity));
+        slab->next = nullptr;
+        slab->base = reinterpret_cast<char*>(slab + 1);
+        slab->capacity = capacity;
+        slab->readIndex = 0;
+        slab->writeIndex = 0;
+        slab->destroy = nullptr;
+        return slab;
+}
+
+void ChainBuffer::freeSlab(Slab* slab)
+{
+        if (slab->destroy != nullptr)
+        {
+                slab->destroy(slab);
+                return;
+        }
+        if (pool_ == nullptr && slab->capacity == kSlabSize && spare_ == nullptr)
+        {
+                spare_ = slab;
+                return;
+        }
+        SlabPool::deallocate(slab);
+}
+
+void ChainBuffer::pushSlab(Slab* slab)
+{
+        if (tail_ == nullptr)
+        {
+                head_ = slab;
+        }
+        else
+        {
+                tail_->next = slab;
+        }
+        tail_ = slab;
+        ++numSlabs_;
+}
+
+void ChainBuffer::popFront()
+{
+        Slab* slab = head_;
+        head_ = slab->next;
+        if (head_ == nullptr)
+        {
+                tail_ = nullptr;
+        }
+        --numSlabs_;
+        if (sendPending())
+        {
+                // 之前的零拷贝发送或者异步发送可能还引用着这个slab
+                pinned_.push_back(std::make_pair(zeroCopyNext_, slab));
+                return;
+        }
+        freeSlab(slab);
+}
+
+// 文件段不占内存 base为nullptr 读写位置是相对offset的字节数
+struct ChainBuffer::FileSlab : Slab
+{
+        static void release(Slab* slab)
+        {
+                FileSlab* file = static_cast<FileSlab*>(slab);
+                ::close(file->fd);
+                delete file;
+        }
+
+        int fd;
+        off_t offset;
+};
+
+// 从slab的读位置开始取len字节 返回取到的字节数 文件段读失败时少于len 错误码在errno中 文件太短为EIO
+size_t ChainBuffer::copyOut(Slab* slab, char* dest, size_t len)
+{
+        if (!slab->isFile())
+        {
+                ::memcpy(dest, slab->data() + slab->readIndex, len);
+                return len;
+        }
+        FileSlab* file = static_cast<FileSlab*>(slab);
+        size_t done = 0;
+        while (done < len)
+        {
+                ssize_t n = ::pread(file->fd, dest + done, len - done, file->offset + slab->readIndex + done);
+                if (n < 0 && errno == EINTR)
+                {
+                        continue;
+                }
+                if (n <= 0)
+                {
+                        if (n == 0)
+                        {
+                                errno = EIO;
+                        }
+                        break;
+                }
+                done += n;
+        }
+        return done;
+}
+
+ChainBuffer::Slab* ChainBuffer::firstFile() const
+{
+        Slab* slab = head_;
+        while (slab != nullptr && !slab->isFile())
+        {
+                slab = slab->next;
+        }
+        return slab;
+}
+
+const char* ChainBuffer::frontData() const
+{
+        return head_ == nullptr || head_->isFile() ? nullptr : head_->data() + head_->readIndex;
+}
+
+size_t ChainBuffer::frontBytes() const
+{
+        return head_ == nullptr ? 0 : head_->readable();
+}
+
+size_t ChainBuffer::peekableBytes() const
+{
+        size_t bytes = 0;
+        for (Slab* slab = head_; slab != nullptr && !slab->isFile(); slab = slab->next)
+        {
+                bytes += slab->readable();
+        }
+        return bytes;
+}
+
+const char* ChainBuffer::peek()
+{
+        if (head_ == nullptr || head_->isFile() || head_->next == nullptr || head_->next->isFile())
+        {
+                return frontData();
+        }
+
+        // 第一个文件段之前的数据跨了多个slab 整理到一个新的slab中挂回链首
+        // 后面没有文件段时它就是链尾 留出一个标准slab的空间给之后的append
+        Slab* file = firstFile();
+        size_t bytes = peekableBytes();
+        Slab* merged = newSlab(file == nullptr ? bytes + kSlabSize : bytes);
+        while (head_ != file)
+        {
+                merged->writeIndex += copyOut(head_, merged->data() + merged->writeIndex, head_->readable());
+                popFront();
+        }
+        merged->next = head_;
+        head_ = merged;
+        if (tail_ == nullptr)
+        {
+                tail_ = merged;
+        }
+        ++numSlabs_;
+        return frontData();
+}
+
+void ChainBuffer::retrieve(size_t len)
+{
+        if (len >= readable_)
+        {
+                retrieveAll();
+                return;
+        }
+        readable_ -= len;
+        while (len > 0)
+        {
+                size_t n = std::min(len, head_->readable());
+                head_->readIndex += n;
+                len -= n;
+                if (head_->readable() == 0)
+                {
+                        popFront();
+                }
+        }
+}
+
+void ChainBuffer::retrieveAll()
+{
+        while (head_ != nullptr)
+        {
+                popFront();
+        }
+        readable_ = 0;
+}
+
+std::string ChainBuffer::retrieveAsString(size_t len)
+{
+        len = std::min(len, readable_);
+        std::string result(len, '\0');
+        size_t copied = 0;
+        for (Slab* slab = head_; slab != nullptr && copied < len; slab = slab->next)
+        {
+                size_t n = std::min(slab->readable(), len - copied);
+                size_t got = copyOut(slab, &result[copied], n);
+                copied += got;
+                if (got < n)
+                {
+                        // 文件段读失败 只取走已经读到的数据 剩下的留给writeFd报同样的错误
+                        int savedErrno = errno;
+                        result.resize(copied);
+                        retrieve(copied);
+                        errno = savedErrno;
+                        return result;
+                }
+        }
+        retrieve(len);
+        return result;
+}
+
+void ChainBuffer::append(const char* data, size_t len)
+{
+        readable_ += len;
+        while (len > 0)
+        {
+                if (tail_ == nullptr || tail_->writable() == 0)
+                {
+                        pushSlab(newSlab(kSlabSize));
+                }
+                size_t n = std::min(len, tail_->writable());
+                ::memcpy(tail_->data() + tail_->writeIndex, data, n);
+                tail_->writeIndex += n;
+                data += n;
+                len -= n;
+        }
+}
+
+// 接管的内存和链表节点一起分配 节点释放时析构被接管的对象
+template <typename T>
+struct ChainBuffer::AdoptedSlab : Slab
+{
+        explicit AdoptedSlab(T&& o) : owner(std::move(o)) {}
+
+        static void release(Slab* slab) { delete static_cast<AdoptedSlab*>(slab); }
+
+        T owner;
+};
+
+// data指向owner移动之前的内存 std::string和vector移动时堆上的内存不会变
+template <typename T>
+void ChainBuffer::adopt(T&& owner, const char* data, size_t len)
+{
+        AdoptedSlab<T>* slab = new AdoptedSlab<T>(std::move(owner));
+        slab->next = nullptr;
+        slab->base = const_cast<char*>(data);
+        slab->capacity = len;
+        slab->readIndex = 0;
+        slab->writeIndex = len;
+        slab->destroy = &AdoptedSlab<T>::release;
+        pushSlab(slab);
+        readable_ += len;
+}
+
+void ChainBuffer::append(std::string&& str, size_t offset)
+{
+        if (offset >= str.size())
+        {
+                return;
+        }
+        size_t len = str.size() - offset;
+        if (len < kAdoptThreshold)
+        {
+                append(str.data() + offset, len);
+                return;
+        }
+        const char* data = str.data() + offset;
+        adopt(std::move(str), data, len);
+}
+
+void ChainBuffer::append(Buffer&& buf)
+{
+        size_t len = buf.readableBytes();
+        if (len < kAdoptThreshold)
+        {
+                append(buf.peek(), len);
+                return;
+        }
+        const char* data = buf.peek();
+        adopt(std::move(buf), data, len);
+}
+
+void ChainBuffer::appendFile(int fd, off_t offset, size_t length)
+{
+        FileSlab* slab = new FileSlab;
+        slab->next = nullptr;
+        slab->base = nullptr;
+        slab->capacity = length;
+        slab->readIndex = 0;
+        slab->writeIndex = length;
+        slab->destroy = &FileSlab::release;
+        slab->fd = fd;
+        slab->offset = offset;
+        pushSlab(slab);
+        readable_ += length;
+}
+
+ssize_t ChainBuffer::readFd(int fd, int *savedErrno)
+{
+        char extrabuf[65536];
+        struct iovec vec[3];
+        int iovcnt = 0;
+
+        Slab* tail = (tail_ != nullptr && tail_->writable() > 0) ? tail_ : nullptr;
+        size_t tailWritable = 0;
+        if (tail != nullptr)
+        {
+                tailWritable = tail->writable();
+                vec[iovcnt].iov_base = tail->data() + tail->writeIndex;
+                vec[iovcnt].iov_len = tailWritable;
+                ++iovcnt;
+        }
+        Slab* fresh = newSlab(kSlabSize);
+        vec[iovcnt].iov_base = fresh->data();
+        vec[iovcnt].iov_len = fresh->capacity;
+        ++iovcnt;
+        vec[iovcnt].iov_base = extrabuf;
+        vec[iovcnt].iov_len = sizeof extrabuf;
+        ++iovcnt;
+
+        const ssize_t n = ::readv(fd, vec, iovcnt);
+        if (n < 0)
+        {
+                *savedErrno = errno;
+                freeSlab(fresh);
+                return n;
+        }
+
+        size_t left = static_cast<size_t>(n);
+        if (tail != nullptr)
+        {
+                size_t m = std::min(left, tailWritable);
+                tail->writeIndex += m;
+                readable_ += m;
+                left -= m;
+        }
+        if (left > 0)
+        {
+                size_t m = std::min(left, fresh->capacity);
+                fresh->writeIndex = m;
+                readable_ += m;
+                left -= m;
+                pushSlab(fresh);
+        }
+        else
+        {
+                freeSlab(fresh);
+        }
+        if (left > 0)
+        {
+                append(extrabuf, left);
+        }
+        return n;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int *savedErrno, size_t zeroCopyThreshold)
+{
+        if (head_ != nullptr && head_->isFile())
+        {
+                // sendfile按offset读 不改变文件自己的偏移
+                FileSlab* file = static_cast<FileSlab*>(head_);
+                off_t offset = file->offset + head_->readIndex;
+                size_t count = std::min(head_->readable(), kMaxSendfileBytes);
+                ssize_t n = ::sendfile(fd, file->fd, &offset, count);
+                if (n < 0)
+                {
+                        *savedErrno = errno;
+                }
+                else if (n == 0)
+                {
+                        // 文件比指定的长度短 剩下的字节永远发不出去
+                        *savedErrno = EIO;
+                        n = -1;
+                }
+                return n;
+        }
+
+        struct iovec vec[kMaxIovecs];
+        int iovcnt = fillIovecs(vec, kMaxIovecs);
+        size_t total = 0;
+        for (int i = 0; i < iovcnt; ++i)
+        {
+                total += vec[i].iov_len;
+        }
+
+        if (zeroCopyThreshold > 0 && total >= zeroCopyThreshold)
+        {
+                struct msghdr msg;
+                ::memset(&msg, 0, sizeof msg);
+                msg.msg_iov = vec;
+                msg.msg_iovlen = iovcnt;
+                ssize_t n = ::sendmsg(fd, &msg, MSG_ZEROCOPY);
+                if (n >= 0)
+                {
+                        ++zeroCopyNext_;
+                        return n;
+                }
+                if (errno != ENOBUFS)
+                {
+                        *savedErrno = errno;
+                        return n;
+                }
+                // 锁住页面用的optmem不够了 这一次改走拷贝
+        }
+
+        ssize_t n = ::writev(fd, vec, iovcnt);
+        if (n < 0)
+        {
+                *savedErrno = errno;
+        }
+        return n;
+}
+
+int ChainBuffer::fillIovecs(struct iovec* vec, int maxIov) const
+{
+        int iovcnt = 0;
+        for (Slab* slab = head_; slab != nullptr && !slab->isFile() && iovcnt < maxIov; slab = slab->next)
+        {
+                vec[iovcnt].iov_base = slab->data() + slab->readIndex;
+                vec[iovcnt].iov_len = slab->readable();
+                ++iovcnt;
+        }
+        return iovcnt;
+}
+
+void ChainBuffer::endAsyncSend()
+{
+        --asyncSends_;
+        releasePinned();
+}
+
+// uint32_t的编号会回绕 按差值比较
+static bool idBefore(uint32_t a, uint32_t b)
+{
+        return static_cast<int32_t>(a - b) < 0;
+}
+
+void ChainBuffer::zeroCopyCompleted(uint32_t lo, uint32_t hi)
+{
+        // TCP的完成通知基本按顺序到达 内核还会把相邻的合并成一个区间
+        zeroCopyRanges_.push_back(std::make_pair(lo, hi));
+        bool advanced = true;
+        while (advanced)
+        {
+                advanced = false;
+                for (size_t i = 0; i < zeroCopyRanges_.size(); ++i)
+                {
+                        if (!idBefore(zeroCopyDone_, zeroCopyRanges_[i].first))
+                        {
+                                if (!idBefore(zeroCopyRanges_[i].second, zeroCopyDone_))
+                                {
+                                        zeroCopyDone_ = zeroCopyRanges_[i].second + 1;
+                                }
+                                zeroCopyRanges_[i] = zeroCopyRanges_.back();
+                                zeroCopyRanges_.pop_back();
+                                advanced = true;
+                                break;
+                        }
+                }
+        }
+        releasePinned();
+}
+
+int ChainBuffer::readZeroCopyCompletions(int fd, bool* kernelCopied)
+{
+        int completions = 0;
+        char control[128];
+        for (;;)
+        {
+                struct msghdr msg;
+                ::memset(&msg, 0, sizeof msg);
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof control;
+                if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+                {
+                        break; // EAGAIN 错误队列读完了
+                }
+                for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+                {
+                        bool recvErr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                                || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+                        if (!recvErr)
+                        {
+                                continue;
+                        }
+                        const struct sock_extended_err* serr = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+                        if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                        {
+                                continue;
+                        }
+                        zeroCopyCompleted(serr->ee_info, serr->ee_data);
+                        ++completions;
+                        if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                        {
+                                *kernelCopied = true;
+                        }
+                }
+        }
+        return completions;
+}
+
+void ChainBuffer::releasePinned()
+{
+        // 挂起时记下的编号之前的发送都完成了 这个slab就不再被引用 异步发送全部完成之前都不释放
+        if (asyncSends_ > 0)
+        {
+                return;
+        }
+        while (!pinned_.empty() && !idBefore(zeroCopyDone_, pinned_.front().first))
+        {
+                freeSlab(pinned_.front().second);
+                pinned_.pop_front();
+        }
+}
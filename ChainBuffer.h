@@ -0,0 +1,148 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "SlabPool.h"
+#include "Buffer.h"
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct iovec;
+
+/*
+ * 由固定大小的slab串成的缓冲区 TcpConnection的outputBuffer_使用
+ * append只往尾部的slab里写 写满了就挂一个新的slab 已有的数据不会被搬动 也没有vector扩容时的整体拷贝
+ * retrieve把读完的slab摘下来 readFd/writeFd用readv/writev一次读写多个slab
+ * 和Buffer一样提供peek/retrieve 只有调用peek()并且数据跨了多个slab时才把数据整理成连续的一段
+ * 指定了SlabPool时标准大小的slab从pool中分配 用完马上还回去 不在自己手里留空闲的slab
+ * append右值的string/Buffer时直接接管它们的内存挂在链上 不拷贝数据 writev时和普通slab一起写出
+ * appendFile挂一个文件段 轮到它时用sendfile发送 数据不经过用户态
+ * writeFd可以用MSG_ZEROCOPY发送 内核直接引用slab的内存 这之后摘下的slab先挂起 等内核确认之后才释放
+ * 也可以用fillIovecs把数据交给io_uring异步发送 请求完成之前摘下的slab同样先挂起
+*/
+class ChainBuffer : noncopyable
+{
+public:
+        static const size_t kSlabSize = SlabPool::kMaxBytes - 48; // 每个slab的数据容量 加上头部正好是pool的一个slab
+        static const int kMaxIovecs = 64;          // writeFd一次最多写的slab数
+        static const size_t kAdoptThreshold = 1024; // 右值数据不少于这个大小才接管 更小的拷贝更划算
+        static const size_t kMaxSendfileBytes = 1 << 30; // 文件段一次sendfile的上限
+
+        explicit ChainBuffer(SlabPool* pool = nullptr);
+        // 接管other的全部数据和零拷贝状态 other变为空的缓冲区
+        // 连接析构时用它把还在等零拷贝完成通知的outputBuffer交给loop保管
+        ChainBuffer(ChainBuffer&& other);
+        // 还有零拷贝发送或者异步发送没完成时 内核可能还引用着的slab不释放也不还给pool 见abandon()
+        ~ChainBuffer();
+
+        // 之后新的slab从pool中分配 已有的slab释放时仍然还给原来的pool 连接迁移到别的loop后调用
+        void setPool(SlabPool* pool);
+
+        size_t readableBytes() const { return readable_; }
+
+        // 第一个slab中可读的数据 不拷贝 配合retrieve可以逐段取完整个缓冲区 文件段的frontData为nullptr
+        const char* frontData() const;
+        size_t frontBytes() const;
+
+        // 链首内存数据的连续视图 跨slab时拷贝到一个足够大的slab中 没有文件段时之后的append接在它后面
+        // 文件段不会被读进内存 视图只到第一个文件段为止 长度是peekableBytes() 可能小于readableBytes()
+        // 链首就是文件段时返回nullptr 先用frontData/frontBytes或者retrieve把文件段取走
+        const char* peek();
+        // peek()视图的长度 即第一个文件段之前的数据量 没有文件段时等于readableBytes()
+        size_t peekableBytes() const;
+
+        void retrieve(size_t len);
+        void retrieveAll();
+        std::string retrieveAllAsString() { return retrieveAsString(readable_); }
+        // 文件段用pread读进来 读失败或者文件比指定的长度短时停在出错的位置 只取走并返回之前的数据
+        // 返回的字符串比len短时errno是出错的原因 文件太短为EIO 和writeFd一样
+        std::string retrieveAsString(size_t len);
+
+        void append(const char* data, size_t len);
+        void append(const std::string& str) { append(str.data(), str.size()); }
+        // 接管str/buf的内存 offset之前的数据不要
+        void append(std::string&& str, size_t offset = 0);
+        void append(Buffer&& buf);
+        // 挂一个文件段[offset, offset + length) 接管fd 发送完或者缓冲区析构时关闭
+        void appendFile(int fd, off_t offset, size_t length);
+
+        // 从fd上读取数据 尾部slab的剩余空间、一个新的slab和栈上的64K依次作为readv的目标
+        ssize_t readFd(int fd, int *savedErrno);
+        // 通过fd发送数据 writev跨slab一次写出 不移动读位置 由调用者retrieve
+        // 遇到文件段时writev只写到它前面 文件段在链首时用sendfile发送 文件比指定的长度短时返回-1 错误码为EIO
+        // 一次要写的数据不少于zeroCopyThreshold时用sendmsg(MSG_ZEROCOPY) 0表示不用 fd需要先开启SO_ZEROCOPY
+        ssize_t writeFd(int fd, int *savedErrno, size_t zeroCopyThreshold = 0);
+        // 从链首开始最多maxIov段内存数据的iovec 遇到文件段为止 返回段数 和writeFd一次writev写的相同
+        int fillIovecs(struct iovec* vec, int maxIov) const;
+
+        // 把fillIovecs的结果交给内核异步发送（io_uring的WRITEV）时调用 直到endAsyncSend之前摘下的slab都先挂起
+        // 发送结果由调用者retrieve
+        void beginAsyncSend() { ++asyncSends_; }
+        void endAsyncSend();
+
+        // 错误队列中读到的零拷贝完成通知 第lo到hi次零拷贝发送已经完成 释放不再被内核引用的slab
+        void zeroCopyCompleted(uint32_t lo, uint32_t hi);
+        // 读完fd错误队列中的零拷贝完成通知并交给zeroCopyCompleted 返回通知的个数
+        // 有内核退回拷贝的通知时把kernelCopied置为true
+        int readZeroCopyCompletions(int fd, bool* kernelCopied);
+        // 是否还有零拷贝发送没有收到完成通知
+        bool zeroCopyPending() const { return zeroCopyDone_ != zeroCopyNext_; }
+        // 内核是否还可能引用着缓冲区的内存
+        bool sendPending() const { return zeroCopyPending() || asyncSends_ > 0; }
+        // 等待内核确认而还没释放的slab数
+        size_t pinnedSlabs() const { return pinned_.size(); }
+        // 放弃所有数据 可能还被内核引用的内存既不释放也不还给pool 只在再也等不到完成通知时使用
+        // 返回泄漏的slab数 由调用者记录日志
+        size_t abandon();
+
+        size_t numSlabs() const { return numSlabs_; }
+private:
+        struct Slab
+        {
+                Slab* next;
+                char* base;              // 自己分配的slab指向头部后面 接管的slab指向被接管的内存
+                size_t capacity;
+                size_t readIndex;
+                size_t writeIndex;
+                void (*destroy)(Slab*);  // 接管的slab用它释放 自己分配的为nullptr
+
+                char* data() { return base; }
+                bool isFile() const { return base == nullptr; }
+                size_t readable() const { return writeIndex - readIndex; }
+                size_t writable() const { return capacity - writeIndex; }
+        };
+
+        template <typename T>
+        struct AdoptedSlab;
+        struct FileSlab;
+
+        Slab* newSlab(size_t capacity);
+        template <typename T>
+        void adopt(T&& owner, const char* data, size_t len);
+        void freeSlab(Slab* slab);
+        void pushSlab(Slab* slab);
+        void popFront();
+        static size_t copyOut(Slab* slab, char* dest, size_t len);
+        bool hasFile() const { return firstFile() != nullptr; }
+        Slab* firstFile() const;
+        void releasePinned();
+
+        Slab* head_;
+        Slab* tail_;
+        Slab* spare_;     // 没有pool时留一个空slab 数据反复清空又写入时不用每次都分配
+        SlabPool* pool_;
+        size_t readable_;
+        size_t numSlabs_;
+
+        // 内核给每次成功的零拷贝发送依次编号 编号小于zeroCopyDone_的都已经完成
+        uint32_t zeroCopyNext_;
+        uint32_t zeroCopyDone_;
+        std::vector<std::pair<uint32_t, uint32_t>> zeroCopyRanges_; // 乱序到达的完成区间
+        std::deque<std::pair<uint32_t, Slab*>> pinned_;              // 摘下时还有零拷贝发送没完成的slab 以及当时的zeroCopyNext_
+        int asyncSends_;                                             // 还没完成的异步发送
+};
@@ -9,7 +9,7 @@ const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::kWriteEvent = EPOLLOUT;
 
 Channel::Channel(EventLoop *loop, int fd)
-    : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), tied_(false)
+    : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), edgeTriggered_(false), exclusive_(false), completionOp_(kNoCompletion), writesByCompletion_(false), tied_(false)
 {
 }
 
@@ -62,7 +62,8 @@ void Channel::handleEvent(Timestamp receiveTime)
 // 根据poller通知的channel发生的事件，调用相应的回调函数 
 void Channel::handleEventWithGuard(Timestamp receiveTime)
 {
-        LOG_INFO("channel handleEvent revents:%d", revents_);
+        // 每个事件都会调用 只输出DEBUG日志
+        LOG_DEBUG("channel handleEvent revents:%d", revents_);
 
         if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN))
         {
@@ -7,6 +7,7 @@
 #include <memory>
 
 class EventLoop;
+struct iovec;
 
 /**
  * EventLoop 包含：
@@ -21,6 +22,20 @@ public:
         using EventCallback = std::function<void()>;
         using ReadEventCallback = std::function<void(Timestamp)>;
 
+        // 完成式读 poller支持时（io_uring）由poller替channel收数据或者接受连接 不支持时照常报告可读事件
+        enum CompletionOp { kNoCompletion, kRecvCompletion, kAcceptCompletion };
+        // kRecvCompletion: data指向收到的res字节 data为空时res是0（对端关闭）或者-errno
+        // kAcceptCompletion: data为空 res是新连接的fd或者-errno
+        // 在poller收割完成事件时调用 只保存结果 之后poller以EPOLLIN回调readCallback处理
+        using CompletionCallback = std::function<void(const char* data, int res)>;
+
+        // 完成式写 poller支持时（io_uring）在poll时把待发送的数据作为一个WRITEV请求提交 所有连接的写和等待合并成一次系统调用
+        // gather最多填maxIov段要发送的数据 返回段数 0表示现在没有能这样发送的数据（比如链首是文件段） poller改为等可写事件
+        // 内存在请求完成之前不能释放 完成时以写出的字节数或者-errno调用writeCompletion 被取消时是-ECANCELED
+        // 没有取消时之后poller以EPOLLOUT回调writeCallback
+        using GatherCallback = std::function<int(struct iovec* vec, int maxIov)>;
+        using WriteCompletionCallback = std::function<void(int res)>;
+
         Channel(EventLoop* loop, int fd);
         ~Channel();
 
@@ -32,13 +47,44 @@ public:
         void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
         void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
         void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+        // 需要在注册到poller之前设置
+        void setCompletionCallback(CompletionOp op, CompletionCallback cb)
+        {
+                completionOp_ = op;
+                completionCallback_ = std::move(cb);
+        }
+        void setWriteCompletionCallback(GatherCallback gather, WriteCompletionCallback cb)
+        {
+                gatherCallback_ = std::move(gather);
+                writeCompletionCallback_ = std::move(cb);
+        }
 
         // 防止当channel被手动remove掉后，channel还在执行回调操作
         void tie(const std::shared_ptr<void>&);
 
         int fd() const { return fd_; }
         int events() const { return events_; }
-        int set_revents(int revt) { revents_ = revt; }
+        int revents() const { return revents_; }
+        void set_revents(int revt) { revents_ = revt; }
+
+        CompletionOp completionOp() const { return completionOp_; }
+        // poller交付一个完成结果
+        void complete(const char* data, int res) { completionCallback_(data, res); }
+
+        bool hasWriteCompletion() const { return static_cast<bool>(gatherCallback_); }
+        int gather(struct iovec* vec, int maxIov) { return gatherCallback_(vec, maxIov); }
+        void completeWrite(int res) { writeCompletionCallback_(res); }
+        // 由poller在注册时设置 为true时所有者不要自己write 把数据留在缓冲区中enableWriting 由poller提交
+        bool writesByCompletion() const { return writesByCompletion_; }
+        void setWritesByCompletion(bool on) { writesByCompletion_ = on; }
+
+        // 边缘触发 需要在注册到poller之前设置 回调中必须把fd读/写到EAGAIN
+        void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+        bool isEdgeTriggered() const { return edgeTriggered_; }
+
+        // EPOLLEXCLUSIVE 多个epoll实例监听同一个fd时每次只唤醒一个 只能在第一次注册时带上 之后不能再修改事件
+        void setExclusive(bool on) { exclusive_ = on; }
+        bool isExclusive() const { return exclusive_; }
 
         // 设置fd相应的事件状态
         void enableReading() { events_ |= kReadEvent; update(); }
@@ -57,6 +103,8 @@ public:
 
         // one loop per thread
         EventLoop* ownerLoop() { return loop_; } // 返回channel所属的loop
+        // 换到另一个loop上 只能在channel不在任何poller上时调用 连接迁移时使用
+        void setOwnerLoop(EventLoop* loop) { loop_ = loop; }
         void remove();
 private:
 
@@ -72,6 +120,10 @@ private:
         int events_;           // 注册fd感兴趣的事件
         int revents_;          // Poller返回的具体发生事件
         int index_;            // 在Poller中的索引
+        bool edgeTriggered_;   // 是否以EPOLLET注册
+        bool exclusive_;       // 是否以EPOLLEXCLUSIVE注册
+        CompletionOp completionOp_; // 支持时由poller完成的读操作
+        bool writesByCompletion_;   // 当前poller替channel提交写请求
 
         std::weak_ptr<void> tie_;
         bool tied_;
@@ -81,4 +133,7 @@ private:
         EventCallback writeCallback_;
         EventCallback closeCallback_;
         EventCallback errorCallback_;
+        CompletionCallback completionCallback_;
+        GatherCallback gatherCallback_;
+        WriteCompletionCallback writeCompletionCallback_;
 };
\ No newline at end of file
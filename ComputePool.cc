@@ -0,0 +1,198 @@
+#include "ComputePool.h"
+#include "Logger.h"
+
+#include <thread>
+
+namespace
+{
+// 当前线程所属的线程池和worker下标 worker中提交的任务直接放进自己的队列
+__thread ComputePool* t_currentPool = nullptr;
+__thread size_t t_workerIndex = 0;
+}
+
+void ComputePool::Strand::post(Task task)
+{
+        bool schedule = false;
+        {
+                std::lock_guard<std::mutex> lock(mutex_);
+                tasks_.push_back(std::move(task));
+                if (!running_)
+                {
+                        running_ = true;
+                        schedule = true;
+                }
+        }
+        if (schedule)
+        {
+                pool_->submit(std::bind(&Strand::runNext, shared_from_this()));
+        }
+}
+
+// 每次只执行一个任务 还有剩余就重新提交 长队列的Strand不会一直占着一个worker
+void ComputePool::Strand::runNext()
+{
+        Task task;
+        {
+                std::lock_guard<std::mutex> lock(mutex_);
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+        }
+
+        task();
+
+        bool more = false;
+        {
+                std::lock_guard<std::mutex> lock(mutex_);
+                more = !tasks_.empty();
+                running_ = more;
+        }
+        if (more)
+        {
+                pool_->submit(std::bind(&Strand::runNext, shared_from_this()));
+        }
+}
+
+// 每个CPU一个worker 取不到CPU数时hardware_concurrency返回0 至少给一个
+static int defaultThreadNum()
+{
+        unsigned cpus = std::thread::hardware_concurrency();
+        return cpus > 0 ? static_cast<int>(cpus) : 1;
+}
+
+ComputePool::ComputePool(const std::string& name)
+        : name_(name)
+        , numThreads_(defaultThreadNum())
+        , nextWorker_(0)
+        , pending_(0)
+        , idleWorkers_(0)
+        , steals_(0)
+        , stopping_(false)
+{
+}
+
+ComputePool::~ComputePool()
+{
+        stop();
+}
+
+void ComputePool::start()
+{
+        for (int i = 0; i < numThreads_; ++i)
+        {
+                workers_.emplace_back(new Worker);
+        }
+        for (int i = 0; i < numThreads_; ++i)
+        {
+                std::string threadName = name_ + std::to_string(i);
+                workers_[i]->thread.reset(new Thread(std::bind(&ComputePool::workerFunc, this, i), threadName));
+                workers_[i]->thread->start();
+        }
+}
+
+void ComputePool::stop()
+{
+        {
+                std::lock_guard<std::mutex> lock(sleepMutex_);
+                if (stopping_)
+                {
+                        return;
+                }
+                stopping_ = true;
+        }
+        sleepCond_.notify_all();
+        for (std::unique_ptr<Worker>& worker : workers_)
+        {
+                if (worker->thread)
+                {
+                        worker->thread->join();
+                }
+        }
+}
+
+void ComputePool::submit(Task task)
+{
+        if (workers_.empty())
+        {
+                // 调用者通常是IO线程 在这里执行CPU密集的任务正好违背了offload的目的
+                LOG_FATAL("ComputePool[%s] has no threads (not started or thread num 0), cannot run submitted tasks \n", name_.c_str());
+        }
+
+        size_t index = t_currentPool == this
+                ? t_workerIndex
+                : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        {
+                Worker& worker = *workers_[index];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                worker.tasks.push_back(std::move(task));
+                // 在锁内增加 取走这个任务的worker一定在这之后才减少 pending_不会先减后加而回绕
+                pending_.fetch_add(1);
+        }
+
+        // 先增加pending_再检查idleWorkers_ worker那边顺序相反 两边至少有一方能看到对方 不会丢失唤醒
+        if (idleWorkers_.load() > 0)
+        {
+                std::lock_guard<std::mutex> lock(sleepMutex_);
+                sleepCond_.notify_one();
+        }
+}
+
+bool ComputePool::takeTask(size_t index, Task* task)
+{
+        // 先取自己队列的头部 按提交顺序执行
+        {
+                Worker& self = *workers_[index];
+                std::lock_guard<std::mutex> lock(self.mutex);
+                if (!self.tasks.empty())
+                {
+                        *task = std::move(self.tasks.front());
+                        self.tasks.pop_front();
+                        return true;
+                }
+        }
+
+        // 再从其他worker队列的尾部偷一个 和队列的主人从两端取 减少冲突
+        for (size_t i = 1; i < workers_.size(); ++i)
+        {
+                Worker& victim = *workers_[(index + i) % workers_.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty())
+                {
+                        *task = std::move(victim.tasks.back());
+                        victim.tasks.pop_back();
+                        steals_.fetch_add(1, std::memory_order_relaxed);
+                        return true;
+                }
+        }
+        return false;
+}
+
+void ComputePool::workerFunc(size_t index)
+{
+        t_currentPool = this;
+        t_workerIndex = index;
+
+        for (;;)
+        {
+                Task task;
+                if (takeTask(index, &task))
+                {
+                        pending_.fetch_sub(1);
+                        task();
+                        continue;
+                }
+
+                std::unique_lock<std::mutex> lock(sleepMutex_);
+                idleWorkers_.fetch_add(1);
+                while (pending_.load() == 0 && !stopping_)
+                {
+                        sleepCond_.wait(lock);
+                }
+                idleWorkers_.fetch_sub(1);
+                if (stopping_ && pending_.load() == 0)
+                {
+                        break; // 提交过的任务都执行完了才退出
+                }
+        }
+
+        t_currentPool = nullptr;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Task.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * 执行CPU密集任务的工作窃取线程池 TcpServer持有 用来把耗时的处理移出IO线程
+ * 每个worker有自己的任务队列和锁 提交的任务轮流放入各个队列 worker从自己队列的头部取
+ * 自己的队列空了就从其他worker队列的尾部偷 只有所有队列都空了才睡眠
+ * submit只会短暂地持有一个worker的锁 从不等待任务执行 IO线程可以放心调用
+*/
+class ComputePool : noncopyable
+{
+public:
+        // 串行执行器 提交到同一个Strand的任务按提交顺序一个接一个执行 不同Strand之间并行
+        // TcpServer给每个连接一个Strand 保证同一连接的任务按顺序完成
+        class Strand : noncopyable, public std::enable_shared_from_this<Strand>
+        {
+        public:
+                explicit Strand(ComputePool* pool) : pool_(pool), running_(false) {}
+
+                void post(Task task);
+        private:
+                void runNext();
+
+                ComputePool* pool_;
+                std::mutex mutex_;
+                std::deque<Task> tasks_;
+                bool running_; // 是否已经有一个runNext提交到了线程池
+        };
+
+        explicit ComputePool(const std::string& name = std::string("ComputePool"));
+        ~ComputePool();
+
+        // 需要在start之前设置 默认每个CPU一个worker 设为0表示不启用 之后submit是编程错误
+        void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+        void start();
+        // 等所有已经提交的任务执行完后退出worker线程
+        void stop();
+
+        // 可以在任意线程调用 没有worker（还没start或者线程数为0）时LOG_FATAL 不会悄悄在调用者（IO线程）中执行
+        void submit(Task task);
+
+        std::shared_ptr<Strand> newStrand() { return std::make_shared<Strand>(this); }
+
+        bool started() const { return !workers_.empty(); }
+        size_t pendingTasks() const { return pending_.load(std::memory_order_relaxed); }
+        uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+private:
+        struct Worker
+        {
+                std::mutex mutex;
+                std::deque<Task> tasks;
+                std::unique_ptr<Thread> thread;
+        };
+
+        void workerFunc(size_t index);
+        bool takeTask(size_t index, Task* task);
+
+        const std::string name_;
+        int numThreads_;
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::atomic<size_t> nextWorker_; // 外部提交时轮流选择的worker
+
+        std::atomic<size_t> pending_;   // 所有队列中的任务数
+        std::atomic<int> idleWorkers_;  // 正在睡眠或准备睡眠的worker数
+        std::atomic<uint64_t> steals_;  // 从其他worker偷到的任务数
+        std::mutex sleepMutex_;
+        std::condition_variable sleepCond_;
+        bool stopping_;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+/*
+ * C++20协程接口 需要用-std=c++20编译使用它的代码 用cmake -DHCNL_CXX20=ON时库本身也以C++20编译
+ *
+ * CoTask echo(TcpConnectionPtr conn)
+ * {
+ *         for (;;)
+ *         {
+ *                 std::string line = co_await conn->readUntil("\r\n");
+ *                 if (line.empty()) co_return;           // 连接断开
+ *                 co_await conn->getLoop()->sleep(0.01);
+ *                 if (!co_await conn->write(line)) co_return;
+ *         }
+ * }
+ *
+ * 协程在连接所属的loop线程中启动（比如在ConnectionCallback里） 之后总是在这个loop线程中恢复
+ * 有协程在等数据时收到的数据交给协程 不再调用MessageCallBack 两种方式可以在同一个服务器的不同连接上混用
+ * 协程帧从每个线程自己的CoroutineFramePool中分配
+*/
+#ifdef __cpp_impl_coroutine
+
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+#include <coroutine>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+// 协程帧的内存池 按kGranularity字节分级缓存释放的帧
+// 帧几乎总是在同一个loop线程中创建和销毁 每个线程一份 不需要加锁
+class CoroutineFramePool
+{
+public:
+        struct Stats
+        {
+                uint64_t allocations; // 分配过的帧数
+                uint64_t reused;      // 其中从缓存中取到的
+                size_t cached;        // 当前缓存着的帧数
+        };
+
+        static void* allocate(size_t size)
+        {
+                Local& local = current();
+                ++local.stats.allocations;
+                size_t cls = classOf(size);
+                if (cls >= kClasses)
+                {
+                        return ::operator new(size);
+                }
+                FreeNode* node = local.lists[cls];
+                if (node != nullptr)
+                {
+                        local.lists[cls] = node->next;
+                        --local.counts[cls];
+                        --local.stats.cached;
+                        ++local.stats.reused;
+                        return node;
+                }
+                return ::operator new((cls + 1) * kGranularity);
+        }
+
+        static void deallocate(void* p, size_t size)
+        {
+                Local& local = current();
+                size_t cls = classOf(size);
+                if (cls >= kClasses || local.counts[cls] >= kMaxCachedPerClass)
+                {
+                        ::operator delete(p);
+                        return;
+                }
+                FreeNode* node = static_cast<FreeNode*>(p);
+                node->next = local.lists[cls];
+                local.lists[cls] = node;
+                ++local.counts[cls];
+                ++local.stats.cached;
+        }
+
+        // 当前线程的统计
+        static Stats stats() { return current().stats; }
+
+private:
+        static const size_t kGranularity = 64;
+        static const size_t kClasses = 64;            // 缓存不超过4KB的帧
+        static const size_t kMaxCachedPerClass = 1024;
+
+        struct FreeNode
+        {
+                FreeNode* next;
+        };
+
+        struct Local
+        {
+                FreeNode* lists[kClasses] = {};
+                size_t counts[kClasses] = {};
+                Stats stats = {};
+
+                ~Local()
+                {
+                        for (FreeNode* head : lists)
+                        {
+                                while (head != nullptr)
+                                {
+                                        FreeNode* next = head->next;
+                                        ::operator delete(head);
+                                        head = next;
+                                }
+                        }
+                }
+        };
+
+        static size_t classOf(size_t size) { return size == 0 ? 0 : (size - 1) / kGranularity; }
+
+        static Local& current()
+        {
+                static thread_local Local local;
+                return local;
+        }
+};
+
+// 立即开始执行、结束时自动销毁的协程 调用者不等待它的结果
+class CoTask
+{
+public:
+        struct promise_type
+        {
+                CoTask get_return_object() { return CoTask(); }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception()
+                {
+                        LOG_FATAL("%s:%s:%d unhandled exception in coroutine \n", __FILE__, __FUNCTION__, __LINE__);
+                }
+
+                static void* operator new(size_t size) { return CoroutineFramePool::allocate(size); }
+                static void operator delete(void* p, size_t size) { CoroutineFramePool::deallocate(p, size); }
+        };
+};
+
+// 等待者的公共部分 挂起时登记到连接上 由连接在loop线程中恢复
+class ConnectionAwaiter : public TcpConnection::IoWaiter
+{
+public:
+        explicit ConnectionAwaiter(TcpConnection* conn) : conn_(conn) {}
+
+        void resume() override { handle_.resume(); }
+protected:
+        TcpConnection* conn_; // 协程的参数持有连接的shared_ptr 挂起期间连接一定存在
+        std::coroutine_handle<> handle_;
+};
+
+// 等到inputBuffer中至少有n个字节 返回inputBuffer 由调用者取走数据 连接断开时返回nullptr
+class ReadAtLeastAwaiter : public ConnectionAwaiter
+{
+public:
+        ReadAtLeastAwaiter(TcpConnection* conn, size_t n) : ConnectionAwaiter(conn), n_(n) {}
+
+        bool ready() override { return conn_->inputBuffer()->readableBytes() >= n_; }
+
+        bool await_ready() { return ready() || !conn_->connected(); }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+                handle_ = handle;
+                conn_->setReadWaiter(this);
+        }
+        Buffer* await_resume() { return ready() ? conn_->inputBuffer() : nullptr; }
+private:
+        size_t n_;
+};
+
+// 等到inputBuffer中出现delim 取走并返回到delim为止（包括delim）的数据 连接断开时返回空串
+class ReadUntilAwaiter : public ConnectionAwaiter
+{
+public:
+        ReadUntilAwaiter(TcpConnection* conn, const std::string& delim)
+                : ConnectionAwaiter(conn), delim_(delim), scanned_(0) {}
+
+        bool ready() override { return find() != std::string::npos; }
+
+        bool await_ready() { return ready() || !conn_->connected(); }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+                handle_ = handle;
+                conn_->setReadWaiter(this);
+        }
+        std::string await_resume()
+        {
+                size_t end = find();
+                if (end == std::string::npos)
+                {
+                        return std::string();
+                }
+                return conn_->inputBuffer()->retrieveAsString(end + delim_.size());
+        }
+private:
+        // 每次从上次没找到的位置往后找 长消息分多次到达时不重复扫描
+        size_t find()
+        {
+                Buffer* buf = conn_->inputBuffer();
+                const size_t len = buf->readableBytes();
+                const char* begin = buf->peek();
+                const char* end = begin + len;
+                const char* pos = std::search(begin + std::min(scanned_, len), end, delim_.begin(), delim_.end());
+                if (pos == end)
+                {
+                        scanned_ = len >= delim_.size() ? len - delim_.size() + 1 : 0;
+                        return std::string::npos;
+                }
+                return pos - begin;
+        }
+
+        std::string delim_;
+        size_t scanned_;
+};
+
+// 发送data 等到outputBuffer全部发送完毕再恢复 返回连接是否还在
+class WriteAwaiter : public ConnectionAwaiter
+{
+public:
+        WriteAwaiter(TcpConnection* conn, std::string data) : ConnectionAwaiter(conn), data_(std::move(data)) {}
+
+        bool ready() override { return conn_->outputBuffer()->readableBytes() == 0; }
+
+        bool await_ready()
+        {
+                conn_->send(std::move(data_));
+                return ready() || !conn_->connected();
+        }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+                handle_ = handle;
+                conn_->setWriteWaiter(this);
+        }
+        bool await_resume() { return conn_->connected(); }
+private:
+        std::string data_; // 持有一份数据 co_await一个临时对象时不会悬空 在await_ready中移交给send
+};
+
+// 在loop的定时器上等待seconds秒
+// 挂起的协程归定时器回调所有 定时器到期前loop就退出时 协程帧随回调一起销毁 帧中持有的连接等也随之释放
+class SleepAwaiter
+{
+public:
+        SleepAwaiter(EventLoop* loop, double seconds) : loop_(loop), seconds_(seconds) {}
+
+        bool await_ready() { return seconds_ <= 0.0; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+                std::shared_ptr<Sleeper> sleeper = std::make_shared<Sleeper>(handle);
+                loop_->runAfter(seconds_, [sleeper]() { sleeper->wake(); });
+        }
+        void await_resume() {}
+private:
+        struct Sleeper
+        {
+                explicit Sleeper(std::coroutine_handle<> h) : handle(h) {}
+                ~Sleeper()
+                {
+                        if (handle)
+                        {
+                                handle.destroy();
+                        }
+                }
+
+                // 恢复之后协程由自己结束 不再归这里销毁
+                void wake()
+                {
+                        std::coroutine_handle<> h = handle;
+                        handle = nullptr;
+                        h.resume();
+                }
+
+                std::coroutine_handle<> handle;
+        };
+
+        EventLoop* loop_;
+        double seconds_;
+};
+
+inline ReadAtLeastAwaiter TcpConnection::readAtLeast(size_t n) { return ReadAtLeastAwaiter(this, n); }
+inline ReadUntilAwaiter TcpConnection::readUntil(const std::string& delim) { return ReadUntilAwaiter(this, delim); }
+inline WriteAwaiter TcpConnection::write(std::string data) { return WriteAwaiter(this, std::move(data)); }
+inline SleepAwaiter EventLoop::sleep(double seconds) { return SleepAwaiter(this, seconds); }
+
+#endif
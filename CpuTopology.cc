@@ -0,0 +1,206 @@
+#include "CpuTopology.h"
+#include "Logger.h"
+
+#include <fstream>
+#include <set>
+#include <utility>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+namespace
+{
+
+// 解析"0-3,8,10-11"这样的CPU列表
+std::vector<int> parseCpuList(const std::string& list)
+{
+        std::vector<int> cpus;
+        size_t pos = 0;
+        while (pos < list.size())
+        {
+                size_t comma = list.find(',', pos);
+                std::string range = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+                int first = 0;
+                int last = 0;
+                int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+                if (n == 1)
+                {
+                        last = first;
+                }
+                if (n >= 1)
+                {
+                        for (int cpu = first; cpu <= last; ++cpu)
+                        {
+                                cpus.push_back(cpu);
+                        }
+                }
+                if (comma == std::string::npos)
+                {
+                        break;
+                }
+                pos = comma + 1;
+        }
+        return cpus;
+}
+
+bool readFirstLine(const std::string& path, std::string* line)
+{
+        std::ifstream in(path.c_str());
+        return static_cast<bool>(std::getline(in, *line));
+}
+
+int readInt(const std::string& path, int defaultValue)
+{
+        std::string line;
+        return readFirstLine(path, &line) ? atoi(line.c_str()) : defaultValue;
+}
+
+} // namespace
+
+namespace CpuTopology
+{
+
+std::vector<int> onlineCpus()
+{
+        std::string line;
+        if (readFirstLine("/sys/devices/system/cpu/online", &line))
+        {
+                std::vector<int> cpus = parseCpuList(line);
+                if (!cpus.empty())
+                {
+                        return cpus;
+                }
+        }
+
+        std::vector<int> cpus;
+        long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < n; ++cpu)
+        {
+                cpus.push_back(static_cast<int>(cpu));
+        }
+        return cpus;
+}
+
+std::vector<int> physicalCores()
+{
+        std::vector<int> cores;
+        std::set<std::pair<int, int>> seen; // (package, core)
+        for (int cpu : onlineCpus())
+        {
+                std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+                int package = readInt(dir + "physical_package_id", 0);
+                int core = readInt(dir + "core_id", cpu);
+                if (seen.insert(std::make_pair(package, core)).second)
+                {
+                        cores.push_back(cpu);
+                }
+        }
+        return cores;
+}
+
+std::vector<std::vector<int>> numaNodes()
+{
+        std::vector<std::vector<int>> nodes;
+        std::string line;
+        if (readFirstLine("/sys/devices/system/node/online", &line))
+        {
+                std::vector<int> online = onlineCpus();
+                std::set<int> onlineSet(online.begin(), online.end());
+                for (int node : parseCpuList(line))
+                {
+                        std::string cpulist;
+                        std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+                        if (!readFirstLine(path, &cpulist))
+                        {
+                                continue;
+                        }
+                        if (static_cast<size_t>(node) >= nodes.size())
+                        {
+                                nodes.resize(node + 1);
+                        }
+                        for (int cpu : parseCpuList(cpulist))
+                        {
+                                if (onlineSet.count(cpu))
+                                {
+                                        nodes[node].push_back(cpu);
+                                }
+                        }
+                }
+        }
+        if (nodes.empty())
+        {
+                nodes.push_back(onlineCpus());
+        }
+        return nodes;
+}
+
+int nodeOfCpu(int cpu)
+{
+        std::vector<std::vector<int>> nodes = numaNodes();
+        for (size_t node = 0; node < nodes.size(); ++node)
+        {
+                for (int c : nodes[node])
+                {
+                        if (c == cpu)
+                        {
+                                return static_cast<int>(node);
+                        }
+                }
+        }
+        return 0;
+}
+
+bool pinCurrentThread(int cpu)
+{
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (::sched_setaffinity(0, sizeof(set), &set) < 0)
+        {
+                LOG_ERROR("sched_setaffinity cpu %d error:%d \n", cpu, errno);
+                return false;
+        }
+        return true;
+}
+
+bool preferMemoryNode(int node)
+{
+        unsigned long mask[16] = {0};
+        const unsigned long bitsPerLong = 8 * sizeof(unsigned long);
+        if (node < 0 || static_cast<unsigned long>(node) >= sizeof(mask) * 8)
+        {
+                return false;
+        }
+        mask[node / bitsPerLong] |= 1UL << (node % bitsPerLong);
+        if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8) < 0)
+        {
+                LOG_ERROR("set_mempolicy node %d error:%d \n", node, errno);
+                return false;
+        }
+        return true;
+}
+
+bool setCurrentThreadName(const std::string& name)
+{
+        // 包括结尾的'\0'最多16字节 超过会返回ERANGE
+        // 截断时保留末尾的序号 线程池中的"name0" "name1"截断后仍然可以区分
+        const size_t kMaxLength = 15;
+        std::string truncated = name;
+        if (truncated.size() > kMaxLength)
+        {
+                size_t digits = truncated.size() - (truncated.find_last_not_of("0123456789") + 1);
+                if (digits >= kMaxLength)
+                {
+                        digits = 0;
+                }
+                truncated = name.substr(0, kMaxLength - digits) + name.substr(name.size() - digits);
+        }
+        return ::pthread_setname_np(::pthread_self(), truncated.c_str()) == 0;
+}
+
+} // namespace CpuTopology
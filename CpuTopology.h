@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * CPU和NUMA拓扑 从/sys/devices/system读取 不依赖libnuma
+ * 以及把当前线程绑定到CPU/NUMA节点上的辅助函数
+ * EventLoopThreadPool用它决定每个loop线程放在哪里
+*/
+namespace CpuTopology
+{
+        // 在线的逻辑CPU
+        std::vector<int> onlineCpus();
+
+        // 每个物理核取一个逻辑CPU（超线程的兄弟只取第一个）
+        std::vector<int> physicalCores();
+
+        // 每个NUMA节点上的在线CPU 下标是节点号 没有NUMA信息时只有一个节点包含所有在线CPU
+        std::vector<std::vector<int>> numaNodes();
+
+        // cpu所在的NUMA节点 找不到时返回0
+        int nodeOfCpu(int cpu);
+
+        // 把当前线程绑定到cpu上
+        bool pinCurrentThread(int cpu);
+
+        // 当前线程之后分配的内存优先从node上分配（MPOL_PREFERRED 节点内存不足时退回其他节点）
+        bool preferMemoryNode(int node);
+
+        // 设置当前线程名 perf/top中显示 内核限制最多15个字符 超出的部分被截掉
+        bool setCurrentThreadName(const std::string& name);
+}
@@ -1,5 +1,7 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
 
 #include <stdlib.h>
 
@@ -10,6 +12,17 @@ Poller* Poller::newDefaultPoller(EventLoop* Loop)
         {
                 return nullptr; //生成poll的实例
         }
+        else if (::getenv("MUDUO_USE_IO_URING"))
+        {
+                IoUringPoller* poller = new IoUringPoller(Loop); //生成io_uring的实例
+                if (poller->valid())
+                {
+                        return poller;
+                }
+                delete poller;
+                LOG_ERROR("io_uring unavailable, fall back to epoll \n");
+                return new EPollPooller(Loop);
+        }
         else
         {
                 return new EPollPooller(Loop); //默认生成epoll的实例
@@ -16,7 +16,8 @@ const int kDeleted = 2;
 EPollPooller::EPollPooller(EventLoop* Loop)
         : Poller(Loop), 
         epollfd_(::epoll_create1(EPOLL_CLOEXEC)), 
-        events_(kInitEventListSize) // vector<epoll_event>
+        events_(kInitEventListSize), // vector<epoll_event>
+        underusedPolls_(0)
 {       
         if (epollfd_ < 0)
         {
@@ -31,8 +32,10 @@ EPollPooller::~EPollPooller()
 
 Timestamp EPollPooller::poll(int timeoutMs, ChannelList* activeChannels) 
 {       
-        // 实际上应该用LOG_DEBUG输出日志更为合理 频繁使用
-        LOG_INFO("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+        // 每轮循环都会调用 忙轮询模式下更是频繁 只输出DEBUG日志
+        LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, numChannels());
+
+        flushPendingUpdates();
 
         int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
         int saveErrno = errno;
@@ -40,12 +43,8 @@ Timestamp EPollPooller::poll(int timeoutMs, ChannelList* activeChannels)
 
         if (numEvents > 0)
         {
-                LOG_INFO("%d events happened \n", numEvents);
+                LOG_DEBUG("%d events happened \n", numEvents);
                 fillActiveChannels(numEvents, activeChannels);
-                if (numEvents == events_.size())
-                {
-                        events_.resize(events_.size() * 2);
-                }
         }
         else if (numEvents == 0)
         {
@@ -59,9 +58,36 @@ Timestamp EPollPooller::poll(int timeoutMs, ChannelList* activeChannels)
                         LOG_ERROR("EPollPoller::poll() err!");
                 }
         }
+        if (numEvents >= 0)
+        {
+                adjustEventListSize(numEvents);
+        }
         return now;
 }
 
+void EPollPooller::adjustEventListSize(int numEvents)
+{
+        const size_t size = events_.size();
+        if (static_cast<size_t>(numEvents) == size)
+        {
+                events_.resize(size * 2);
+                underusedPolls_ = 0;
+        }
+        else if (size > kInitEventListSize && static_cast<size_t>(numEvents) < size / 4)
+        {
+                if (++underusedPolls_ >= kShrinkAfterPolls)
+                {
+                        // resize不会释放内存 用swap真正把容量还回去
+                        EventList(size / 2).swap(events_);
+                        underusedPolls_ = 0;
+                }
+        }
+        else
+        {
+                underusedPolls_ = 0;
+        }
+}
+
 // channel update remove => EventLoop updateChannel removeChannel => Poller updateChannel removeChannel => EPollPoller updateChannel removeChannel
 /*
  *              EventLoop   =>  poller.poll
@@ -72,39 +98,22 @@ Timestamp EPollPooller::poll(int timeoutMs, ChannelList* activeChannels)
 void EPollPooller::updateChannel(Channel* channel)
 {
         const int index = channel->index();
-        LOG_INFO("func=%s => fd = %d events = %d index = %d\n",  __FUNCTION__, channel->fd(), channel->events(), index);
+        const int fd = channel->fd();
+        LOG_INFO("func=%s => fd = %d events = %d index = %d\n",  __FUNCTION__, fd, channel->events(), index);
 
-        if (index == kNew || index == kDeleted)
+        countInterestUpdate();
+        if (index == kNew)
         {
-                // a new one, add with EPOLL_CTL_ADD
-                int fd = channel->fd();
-                if (index == kNew)
-                {
-                        // channelMap_ <fd, channel*>
-                        channels_[fd] = channel;
-                }
-                else // index == kDeleted
-                {
-                        // channelMap_ <fd, channel*>
-                        channels_[fd] = channel;
-                }
-
-                channel->set_index(kAdded);
-                update(EPOLL_CTL_ADD, channel); 
+                // channel表 以fd为下标 先放进表里 真正注册到epoll要等到flush
+                insertChannel(channel);
+                channel->set_index(kDeleted);
         }
-        else 
+
+        Interest& interest = interestOf(fd);
+        if (!interest.dirty)
         {
-                // update existing one with EPOLL_CTL_MOD/DEL
-                int fd = channel->fd();
-                if (channel->isNoneEvent())
-                {
-                        update(EPOLL_CTL_DEL, channel);
-                        channel->set_index(kDeleted);
-                }
-                else
-                {
-                        update(EPOLL_CTL_MOD, channel);
-                }
+                interest.dirty = true;
+                dirtyFds_.push_back(fd);
         }
 }
 
@@ -112,24 +121,90 @@ void EPollPooller::updateChannel(Channel* channel)
 void EPollPooller::removeChannel(Channel* channel) 
 {
         int fd = channel->fd();
-        channels_.erase(fd);
+        eraseChannel(fd);
 
         LOG_INFO("func=%s => fd = %d\n", __FUNCTION__, fd);
-        
+
+        countInterestUpdate();
+        // 还没提交的变化直接作废 fd留在dirtyFds_中 flush时会因为dirty为false被跳过
+        interestOf(fd).dirty = false;
+
         int index = channel->index();
         if (index == kAdded)
         {
-                update(EPOLL_CTL_DEL, channel);
+                update(EPOLL_CTL_DEL, channel, 0);
         }
         channel->set_index(kNew);
 }
 
+void EPollPooller::flushPendingUpdates()
+{
+        for (int fd : dirtyFds_)
+        {
+                Interest& interest = interests_[fd];
+                if (!interest.dirty)
+                {
+                        continue;
+                }
+                interest.dirty = false;
+
+                Channel* channel = findChannel(fd);
+                const uint32_t wanted = wantedEvents(channel);
+                if (channel->index() == kAdded)
+                {
+                        if (wanted == 0)
+                        {
+                                update(EPOLL_CTL_DEL, channel, 0);
+                                channel->set_index(kDeleted);
+                        }
+                        else if (wanted != interest.registered)
+                        {
+                                update(EPOLL_CTL_MOD, channel, wanted);
+                        }
+                        // 和内核中的一样 不需要epoll_ctl
+                }
+                else if (wanted != 0)
+                {
+                        update(EPOLL_CTL_ADD, channel, wanted);
+                        channel->set_index(kAdded);
+                }
+        }
+        dirtyFds_.clear();
+}
+
+uint32_t EPollPooller::wantedEvents(Channel* channel) const
+{
+        uint32_t events = static_cast<uint32_t>(channel->events());
+        if (channel->isEdgeTriggered() && events != 0)
+        {
+                events |= EPOLLET;
+        }
+        return events;
+}
+
+EPollPooller::Interest& EPollPooller::interestOf(int fd)
+{
+        if (static_cast<size_t>(fd) >= interests_.size())
+        {
+                Interest empty = { 0, false };
+                interests_.resize(fd + 1, empty);
+        }
+        return interests_[fd];
+}
+
 // 填写活跃的连接
 void EPollPooller::fillActiveChannels(int numEvents, ChannelList* activeChannels) const
 {
         for (int i = 0 ; i < numEvents ; ++i)
         {
-           Channel *channel = static_cast<Channel*>(events_[i].data.ptr);
+           // data中保存的是fd和注册时的generation 而不是Channel的裸指针
+           int fd = static_cast<int>(events_[i].data.u64 & 0xffffffff);
+           uint32_t generation = static_cast<uint32_t>(events_[i].data.u64 >> 32);
+           Channel *channel = findChannel(fd);
+           if (channel == nullptr || generationOf(fd) != generation)
+           {
+                   continue; // fd已经被移除或者重新注册过了 这是一个失效的事件
+           }
            channel -> set_revents(events_[i].events);
            activeChannels->push_back(channel); 
            // EventLoop就拿到了它的poller给他返回的所有发生事件的channel列表了  
@@ -137,15 +212,22 @@ void EPollPooller::fillActiveChannels(int numEvents, ChannelList* activeChannels
 }
 
 // 更新channel通道 epoll_ctl add/mod/del
-void EPollPooller::update(int operation, Channel* channel)
+void EPollPooller::update(int operation, Channel* channel, uint32_t events)
 {
         struct epoll_event event;
         bzero(&event, sizeof(event));
         int fd = channel->fd();
 
-        event.events = channel->events();
-        event.data.fd = fd;
-        event.data.ptr = channel;
+        countInterestKernelOps(1);
+        interestOf(fd).registered = events;
+        event.events = events;
+        if (channel->isExclusive() && operation == EPOLL_CTL_ADD)
+        {
+                // 内核只允许EPOLLEXCLUSIVE和IN/OUT/ET等一起使用 带EPOLLPRI会返回EINVAL
+                event.events &= ~EPOLLPRI;
+                event.events |= EPOLLEXCLUSIVE;
+        }
+        event.data.u64 = (static_cast<uint64_t>(generationOf(fd)) << 32) | static_cast<uint32_t>(fd);
         
 
         if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
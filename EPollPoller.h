@@ -12,6 +12,10 @@ class Channel;
  * epoll_create() 创建一个epoll句柄，返回值是epoll的句柄fd
  * epoll_ctl()  add/mod/del 控制epoll的行为，注册事件，修改事件，删除事件
  * epoll_wait() 等待事件的产生，类似于select()调用
+ *
+ * updateChannel不立即调用epoll_ctl 只把fd记为dirty 等到下一次poll之前统一提交
+ * 一轮循环里反复打开关闭EPOLLOUT最终只按净变化调用一次epoll_ctl 没有变化就不调用
+ * removeChannel仍然立即生效 因为之后fd马上就会被close
 */
 class EPollPooller : public Poller
 {
@@ -25,14 +29,33 @@ public:
         void removeChannel(Channel* channel) override;
 private:
         static const int kInitEventListSize = 16;
+        // 连续这么多次poll返回的事件数都不到容量的1/4 就把events_缩小一半
+        static const int kShrinkAfterPolls = 64;
 
+        // 根据本次返回的事件数调整events_的大小 满了就扩大一倍 长期空闲就缩小一半
+        void adjustEventListSize(int numEvents);
         // 填写活跃的连接
         void fillActiveChannels(int numEvents, ChannelList* activeChannels) const;
+        // 把这一轮累积的关注事件变化提交给内核
+        void flushPendingUpdates();
+        // channel当前希望在epoll中注册的事件
+        uint32_t wantedEvents(Channel* channel) const;
         // 更新channel通道
-        void update(int operation, Channel* channel);
+        void update(int operation, Channel* channel, uint32_t events);
+
+        // 每个fd在内核中注册的事件 以fd为下标
+        struct Interest
+        {
+                uint32_t registered; // 内核中当前的事件 index为kAdded时有效
+                bool dirty;          // 是否在dirtyFds_中等待提交
+        };
+        Interest& interestOf(int fd);
 
         using EventList = std::vector<epoll_event>;
 
         int epollfd_;
         EventList events_;
+        std::vector<Interest> interests_;
+        std::vector<int> dirtyFds_; // 本轮关注事件发生过变化的fd
+        int underusedPolls_; // 连续低使用率的poll次数
 };
\ No newline at end of file
@@ -2,6 +2,11 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
+#include "TimingWheel.h"
+#include "SlabPool.h"
+#include "Socket.h"
+#include "ChainBuffer.h"
 
 #include  <sys/eventfd.h>
 #include  <unistd.h>
@@ -15,6 +20,13 @@ __thread EventLoop * t_loopInThisThread = nullptr;
 // 定义默认的Poller IO复用接口的超时时间
 const int kPollTimeMs = 10000;
 
+// 时间轮的tick间隔 单位秒
+const double kTimingWheelTickSeconds = 1.0;
+
+// 关闭的连接等待零拷贝完成通知的检查间隔和最长时间 单位秒
+const double kZeroCopyGraveCheckSeconds = 0.1;
+const double kZeroCopyGraveTimeoutSeconds = 30.0;
+
 // 创建wakefd，用来notify唤醒subReactor处理新用户的channel
 int createEventfd()
 {
@@ -29,12 +41,20 @@ int createEventfd()
 EventLoop::EventLoop()
         : looping_(false),
           quit_(false),
-          callingPendingFunctors_(false),
           threadId_(CurrentThread::tid()),
           poller_(Poller::newDefaultPoller(this)),
+          timerQueue_(new TimerQueue(this)),
+          slabPool_(new SlabPool),
+          numZeroCopyGraves_(0),
           wakeupFd_(createEventfd()),
-          wakeupChannel_(new Channel(this, wakeupFd_))
-          
+          wakeupChannel_(new Channel(this, wakeupFd_)),
+          callingPendingFunctors_(false),
+          maxFunctorsPerLoop_(0),
+          maxFunctorMicrosPerLoop_(0),
+          numConnections_(0),
+          retired_(false),
+          wakeupPending_(false),
+          busyPollMicros_(0)
 {
         LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
         if (t_loopInThisThread)
@@ -57,6 +77,17 @@ EventLoop::~EventLoop()
         wakeupChannel_->disableAll();
         wakeupChannel_->remove();
         ::close(wakeupFd_);
+        // 等不到完成通知了 内存不能再还给pool
+        for (ZeroCopyGrave& grave : zeroCopyGraves_)
+        {
+                size_t leaked = grave.buffer->abandon();
+                LOG_ERROR("EventLoop::~EventLoop fd=%d zero copy not completed, abandon %zu slabs \n",
+                        grave.socket->fd(), leaked);
+        }
+        zeroCopyGraves_.clear();
+        numZeroCopyGraves_.store(0, std::memory_order_relaxed);
+        slabPool_->detachOwner();
+        slabPool_->release();
         t_loopInThisThread = nullptr;
 }
 
@@ -68,16 +99,27 @@ void EventLoop::loop()
 
         LOG_INFO("EventLoop %p start looping \n", this);
 
+        // 统计用单调时钟 每轮三次vDSO调用
+        Timestamp iterationStart = Timestamp::monotonic();
         while (!quit_)
         {
                 activeChannels_.clear();
                 // 阻塞 监听两类fd 一种是client的fd 一种是wakeupfd
-                pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+                pollReturnTime_ = pollActiveChannels();
+                // 每轮循环只读一次时钟 本轮的回调、定时器和日志都使用这个时间
+                Timestamp::setCachedNow(pollReturnTime_);
+                Timestamp polled = Timestamp::monotonic();
+                // 本轮IO事件分发中登记的让出任务留到下一轮
+                runningNextIteration_.swap(nextIteration_);
                 for (Channel* channel : activeChannels_)
                 {
                         // Poller监听哪些channe发生事件了，然后就上报给EventLoop，通知channel处理相应事件
                         channel->handleEvent(pollReturnTime_);
                 }
+                runNextIteration();
+                runAfterDispatch();
+                Timestamp dispatched = Timestamp::monotonic();
+                size_t depth = pendingDepth();
                 // 执行当前EventLoop事件循环需要处理的回调操作
                 /*
                  * IO线程 mainLoop accept fd 《= channel subloop
@@ -85,12 +127,61 @@ void EventLoop::loop()
                  * wakeup subloop后，执行下面的方法，执行之前mainloop注册的cb操作
                 */
                 doPendingFunctors();
+                runAfterDispatch();
+                Timestamp done = Timestamp::monotonic();
+
+                metrics_.recordIteration(polled - iterationStart, dispatched - polled, done - dispatched,
+                        activeChannels_.size(), depth);
+                iterationStart = done;
         }
 
+        Timestamp::setCachedNow(Timestamp::invalid());
         LOG_INFO("EventLoop %p stop looping \n", this);
         looping_ = false; 
 }
 
+void EventLoop::runAfterDispatch()
+{
+        // 执行中登记的任务留到下一次检查
+        runningAfterDispatch_.swap(afterDispatch_);
+        for (Functor& cb : runningAfterDispatch_)
+        {
+                cb();
+        }
+        runningAfterDispatch_.clear();
+}
+
+void EventLoop::runNextIteration()
+{
+        for (Functor& cb : runningNextIteration_)
+        {
+                cb();
+        }
+        runningNextIteration_.clear();
+}
+
+// 忙轮询模式下先以0超时反复poll 直到有事件或者用完spin预算才退回阻塞poll
+// 用CPU换延迟 省掉线程睡眠和唤醒的开销
+Timestamp EventLoop::pollActiveChannels()
+{
+        const int64_t budget = busyPollMicros_.load(std::memory_order_relaxed);
+        if (budget > 0 && !hasPendingFunctors())
+        {
+                Timestamp deadline(Timestamp::monotonic().microSecondsSinceEpoch() + budget);
+                do
+                {
+                        Timestamp now = poller_->poll(0, &activeChannels_);
+                        if (!activeChannels_.empty())
+                        {
+                                return now;
+                        }
+                } while (!quit_ && Timestamp::monotonic() < deadline);
+        }
+        // 还有留到下一轮的任务 只检查一下IO事件就回来继续执行
+        const bool noWait = quit_ || hasPendingFunctors();
+        return poller_->poll(noWait ? 0 : kPollTimeMs, &activeChannels_);
+}
+
 // 退出事件循环 1.loop在自己的线程中调用quit 2.loop在其他线程中调用quit
 /*
  *             mainLoop
@@ -116,17 +207,14 @@ void EventLoop::runInLoop(Functor cb)
         }
         else  // 在非当前loop线程中执行cb，就需要唤醒loop所在线程，执行cb
         {
-                queueInLoop(cb);
+                queueInLoop(std::move(cb));
         }
 }
         
 // 将cb放入队列中，唤醒loop所在线程，执行cb
-void EventLoop::queueInLoop(Functor cb)
+void EventLoop::queueInLoop(Functor cb, Priority priority)
 {
-        {
-                std::unique_lock<std::mutex> lock(mutex_);
-                pendingFunctors_.emplace_back(cb);
-        }
+        pendingFunctors_[priority].queue.push(std::move(cb));
 
         // 唤醒相应的，需要执行上面回调操作的loop的线程
         // || 在执行回调 有新的回调加入时，需要唤醒loop所在线程
@@ -144,11 +232,19 @@ void EventLoop::handleRead()
         {
                 LOG_ERROR("EventLoop::handleRead() reads %lu bytes instead of 8 \n", n);
         }
+        metrics_.recordWakeup();
+        // 必须在doPendingFunctors取队列之前清掉 之后入队的生产者会重新写wakeupFd_
+        wakeupPending_.exchange(false, std::memory_order_acq_rel);
 }
 
 // 用来唤醒loop所在线程 向wakeupfd写入数据
 void EventLoop::wakeup()
 {
+        // 已经有一次唤醒还没被loop处理 它会顺带执行本次入队的回调 省掉一次write系统调用
+        if (wakeupPending_.exchange(true, std::memory_order_acq_rel))
+        {
+                return;
+        }
         uint64_t one = 1;
         ssize_t n = ::write(wakeupFd_, &one, sizeof(one));
         if (n != sizeof(one))
@@ -157,6 +253,88 @@ void EventLoop::wakeup()
         }
 }
 
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+        return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+        Timestamp time(addTime(Timestamp::now(), delay));
+        return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+        Timestamp time(addTime(Timestamp::now(), interval));
+        return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+        timerQueue_->cancel(timerId);
+}
+
+TimingWheel* EventLoop::timingWheel()
+{
+        if (!timingWheel_)
+        {
+                // 整个时间轮只用一个重复定时器推进 而不是每个连接一个定时器
+                timingWheel_.reset(new TimingWheel(kTimingWheelTickSeconds));
+                runEvery(kTimingWheelTickSeconds, std::bind(&TimingWheel::advance, timingWheel_.get()));
+        }
+        return timingWheel_.get();
+}
+
+void EventLoop::buryZeroCopy(std::unique_ptr<Socket> socket, std::unique_ptr<ChainBuffer> buffer)
+{
+        // 任务要能拷贝 裸指针带到loop线程中再接管
+        runInLoop(std::bind(&EventLoop::buryZeroCopyInLoop, this, socket.release(), buffer.release()));
+}
+
+void EventLoop::buryZeroCopyInLoop(Socket* socket, ChainBuffer* buffer)
+{
+        ZeroCopyGrave grave;
+        grave.socket.reset(socket);
+        grave.buffer.reset(buffer);
+        grave.deadline = addTime(Timestamp::now(), kZeroCopyGraveTimeoutSeconds);
+        zeroCopyGraves_.push_back(std::move(grave));
+        numZeroCopyGraves_.store(static_cast<int>(zeroCopyGraves_.size()), std::memory_order_relaxed);
+        if (zeroCopyGraves_.size() == 1)
+        {
+                // 全部释放时由drainZeroCopyGraves取消
+                zeroCopyTimer_ = runEvery(kZeroCopyGraveCheckSeconds, std::bind(&EventLoop::drainZeroCopyGraves, this));
+        }
+}
+
+void EventLoop::drainZeroCopyGraves()
+{
+        Timestamp now = Timestamp::now();
+        for (auto it = zeroCopyGraves_.begin(); it != zeroCopyGraves_.end(); )
+        {
+                bool kernelCopied = false;
+                it->buffer->readZeroCopyCompletions(it->socket->fd(), &kernelCopied);
+                if (it->buffer->zeroCopyPending() && now < it->deadline)
+                {
+                        ++it;
+                        continue;
+                }
+                if (it->buffer->zeroCopyPending())
+                {
+                        size_t leaked = it->buffer->abandon();
+                        LOG_ERROR("EventLoop::drainZeroCopyGraves fd=%d zero copy not completed in %.0f s, abandon %zu slabs \n",
+                                it->socket->fd(), kZeroCopyGraveTimeoutSeconds, leaked);
+                }
+                // 析构buffer把slab还给pool 析构socket关闭连接
+                it = zeroCopyGraves_.erase(it);
+        }
+        numZeroCopyGraves_.store(static_cast<int>(zeroCopyGraves_.size()), std::memory_order_relaxed);
+        if (zeroCopyGraves_.empty())
+        {
+                cancel(zeroCopyTimer_);
+        }
+}
+
 // EventLoop的方法  ==>  Poller的方法
 void EventLoop::updateChannel(Channel* channel)
 {
@@ -173,20 +351,97 @@ bool EventLoop::hasChannel(Channel* channel)
         return poller_->hasChannel(channel);
 }
 
+uint64_t EventLoop::interestUpdates() const
+{
+        return poller_->interestUpdates();
+}
+
+uint64_t EventLoop::interestKernelOps() const
+{
+        return poller_->interestKernelOps();
+}
+
 void EventLoop::doPendingFunctors() // 执行loop中的回调函数
 {
-        std::vector<Functor> functors;
         callingPendingFunctors_ = true;
 
+        const int maxFunctors = maxFunctorsPerLoop_.load(std::memory_order_relaxed);
+        const int64_t maxMicros = maxFunctorMicrosPerLoop_.load(std::memory_order_relaxed);
+        const Timestamp deadline = maxMicros > 0
+                ? Timestamp(Timestamp::monotonic().microSecondsSinceEpoch() + maxMicros)
+                : Timestamp::invalid();
+        int count = 0;
+        bool exhausted = false;
+
+        for (PendingQueue& pending : pendingFunctors_)
+        {
+                // 上一轮留下的任务执行完之前不取新的 保证先入队的先执行
+                if (pending.next == pending.running.size())
+                {
+                        pending.running.clear();
+                        pending.next = 0;
+                        pending.queue.popAll(pending.running);
+                }
+
+                const size_t first = pending.next;
+                while (!exhausted && pending.next < pending.running.size())
+                {
+                        // 先移出来再执行 任务捕获的对象执行完就释放
+                        Functor functor(std::move(pending.running[pending.next++]));
+                        functor();  // 执行当前loop需要执行的回调操作
+                        ++count;
+                        exhausted = (maxFunctors > 0 && count >= maxFunctors)
+                                || (deadline.valid() && Timestamp::monotonic() >= deadline);
+                }
+
+                // 只有loop线程写这些计数 不需要原子的读改写
+                const size_t left = pending.running.size() - pending.next;
+                pending.carried.store(left, std::memory_order_relaxed);
+                pending.executed.store(pending.executed.load(std::memory_order_relaxed) + (pending.next - first),
+                        std::memory_order_relaxed);
+                if (left > 0)
+                {
+                        pending.carryOvers.store(pending.carryOvers.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_relaxed);
+                }
+        }
+
+        callingPendingFunctors_ = false;
+}
+
+bool EventLoop::hasPendingFunctors() const
+{
+        if (!afterDispatch_.empty() || !nextIteration_.empty())
+        {
+                return true;
+        }
+        for (const PendingQueue& pending : pendingFunctors_)
         {
-                std::unique_lock<std::mutex> lock(mutex_);
-                functors.swap(pendingFunctors_);
+                // 生产者比loop快时popAll可能没有取完 也算作留到下一轮
+                if (pending.next < pending.running.size() || !pending.queue.empty())
+                {
+                        return true;
+                }
         }
+        return false;
+}
 
-        for (const Functor& functor : functors)
+size_t EventLoop::pendingDepth() const
+{
+        size_t depth = 0;
+        for (const PendingQueue& pending : pendingFunctors_)
         {
-                functor();  // 执行当前loop需要执行的回调操作
+                depth += pending.queue.size() + (pending.running.size() - pending.next);
         }
+        return depth;
+}
 
-        callingPendingFunctors_ = false;
-}
\ No newline at end of file
+EventLoop::PendingStats EventLoop::pendingStats(Priority priority) const
+{
+        const PendingQueue& pending = pendingFunctors_[priority];
+        PendingStats stats;
+        stats.depth = pending.queue.size() + pending.carried.load(std::memory_order_relaxed);
+        stats.executed = pending.executed.load(std::memory_order_relaxed);
+        stats.carryOvers = pending.carryOvers.load(std::memory_order_relaxed);
+        return stats;
+}
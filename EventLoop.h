@@ -9,15 +9,45 @@
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "MpscQueue.h"
+#include "Task.h"
+#include "EventLoopMetrics.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
+class TimingWheel;
+class SlabPool;
+class Socket;
+class ChainBuffer;
+#ifdef __cpp_impl_coroutine
+class SleepAwaiter;
+#endif
 
 // 时间循环类 主要包含两大模块 Channel Poller（epoll的抽象）
 class EventLoop : noncopyable
 {
 public: 
-        using Functor = std::function<void()>;
+        // 只能移动的任务 小闭包不分配内存
+        using Functor = Task;
+
+        // 投递任务的优先级 每轮先执行完默认优先级的任务 预算还有剩余才执行低优先级的
+        enum Priority
+        {
+                kDefaultPriority, // 库内部投递的任务和普通任务
+                kLowPriority,     // 可以延后的批量任务
+                kNumPriorities,
+        };
+
+        // 某个优先级的队列统计 可以在任意线程读取
+        struct PendingStats
+        {
+                size_t depth;        // 还没执行的任务数 包括上一轮留下的
+                uint64_t executed;   // 累计执行的任务数
+                uint64_t carryOvers; // 有任务因为预算用完被留到下一轮的轮数
+        };
 
         EventLoop();
         ~EventLoop();
@@ -27,27 +57,109 @@ public:
         // 退出事件寻
         void quit();
 
+        // 本轮poll返回的时间 也是当前线程Timestamp::cachedNow()的值
         Timestamp pollReturnTime() const { return pollReturnTime_; }
 
-        // 在当前loop中执行cb
+        // 在当前loop中执行cb cb一路被移动 不会被拷贝
         void runInLoop(Functor cb);
         // 将cb放入队列中，唤醒loop所在线程，执行cb
-        void queueInLoop(Functor cb);
+        void queueInLoop(Functor cb, Priority priority = kDefaultPriority);
+
+        // 每轮执行投递任务的预算 个数或者微秒数 任意一个用完剩下的任务就留到下一轮 先回去处理IO
+        // 0表示不限制 默认都不限制 可以在任意线程设置
+        void setFunctorBudget(int maxFunctors, int64_t maxMicros)
+        {
+                maxFunctorsPerLoop_ = maxFunctors;
+                maxFunctorMicrosPerLoop_ = maxMicros;
+        }
+        PendingStats pendingStats(Priority priority) const;
+
+        // 在本轮的事件分发结束后执行cb 投递任务执行完之后还会再检查一次 只能在loop线程中调用
+        // corked的连接用它把一轮中的多次send合并成一次writev
+        void queueAfterDispatch(Functor cb) { afterDispatch_.push_back(std::move(cb)); }
+        // 在下一轮poll并分发完IO事件之后执行cb 只能在loop线程中调用 登记后本轮poll不阻塞
+        // 读写达到公平上限的连接用它让出 同一loop上其他就绪的channel先被处理
+        void queueNextIteration(Functor cb) { nextIteration_.push_back(std::move(cb)); }
+
+        // 本loop的运行统计 可以在任意线程调用 不需要停下loop
+        EventLoopMetrics::Snapshot metrics() const { return metrics_.snapshot(); }
+
+        // 负载均衡用的负载信息 可以在任意线程读取
+        // 归属于本loop的连接数 TcpConnection构造时加一 connectDestroyed时减一 迁移中的连接两边都算
+        // 已经销毁但还被用户代码持有的连接不算
+        int numConnections() const { return numConnections_.load(std::memory_order_relaxed); }
+        void adjustConnections(int delta) { numConnections_.fetch_add(delta, std::memory_order_relaxed); }
+
+        // 从线程池中移除后设置 之后不会再有连接迁入 可以在任意线程调用
+        void setRetired() { retired_.store(true, std::memory_order_release); }
+        bool retired() const { return retired_.load(std::memory_order_acquire); }
+        // 最近的忙碌程度 千分比
+        uint32_t recentLoadPermille() const { return metrics_.recentLoadPermille(); }
 
         // 用来唤醒loop所在线程
         void wakeup();
 
+        // 定时器 可以在任意线程调用 回调在loop线程中执行
+        // 在time时刻执行cb
+        TimerId runAt(Timestamp time, TimerCallback cb);
+        // delay秒之后执行cb
+        TimerId runAfter(double delay, TimerCallback cb);
+        // 每隔interval秒执行一次cb
+        TimerId runEvery(double interval, TimerCallback cb);
+        // 取消定时器
+        void cancel(TimerId timerId);
+#ifdef __cpp_impl_coroutine
+        // co_await loop->sleep(seconds) 在本loop线程中恢复 定义在Coroutine.h中
+        SleepAwaiter sleep(double seconds);
+#endif
+
+        // 忙轮询的spin预算 单位微秒 0表示关闭 可以在任意线程设置 每个loop独立
+        // 开启后loop在阻塞之前先以0超时反复poll这么长时间 并给新连接设置SO_BUSY_POLL
+        void setBusyPollMicros(int64_t micros) { busyPollMicros_ = micros; }
+        int64_t busyPollMicros() const { return busyPollMicros_; }
+
+        // 本loop的时间轮 第一次使用时创建并由loop自己的定时器每个tick推进一次 只能在loop线程中调用
+        TimingWheel* timingWheel();
+
+        // 本loop的slab内存池 连接的缓冲区从这里分配 统计和大页开关可以在任意线程访问
+        SlabPool* slabPool() const { return slabPool_; }
+
+        // 连接销毁时还有零拷贝发送没收到完成通知 把socket和outputBuffer交给loop保管 可以在任意线程调用
+        // loop定时读socket的错误队列 全部完成之后才把slab还给pool并关闭socket 超时还没完成就放弃这些内存
+        void buryZeroCopy(std::unique_ptr<Socket> socket, std::unique_ptr<ChainBuffer> buffer);
+        // 还在等零拷贝完成通知的连接数 可以在任意线程读取 不为0时loop还不能结束 否则这些内存只能泄漏
+        int numZeroCopyGraves() const { return numZeroCopyGraves_.load(std::memory_order_relaxed); }
+
         // EventLoop的方法  ==>  Poller的方法
         void updateChannel(Channel* channel);
         void removeChannel(Channel* channel);
         bool hasChannel(Channel* channel);
 
+        // 关注事件更新的统计 见Poller::interestUpdates() 只能在loop线程中调用
+        uint64_t interestUpdates() const;
+        uint64_t interestKernelOps() const;
+
         // 判断EventLoop是否在当前线程中
         bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
 private:
         void handleRead(); // wake up
+        Timestamp pollActiveChannels(); // 等待channel发生事件 忙轮询模式下先spin
         void doPendingFunctors(); // 执行loop中的回调函数
+        bool hasPendingFunctors() const; // 是否有留到下一轮的任务 有的话poll不阻塞
+        size_t pendingDepth() const; // 所有优先级还没执行的任务数
+        void runAfterDispatch(); // 执行queueAfterDispatch登记的任务
+        void runNextIteration(); // 执行上一轮queueNextIteration登记的任务
+        void buryZeroCopyInLoop(Socket* socket, ChainBuffer* buffer);
+        void drainZeroCopyGraves(); // 读错误队列 释放已经完成的
+
+        // 等待零拷贝完成通知的已关闭连接
+        struct ZeroCopyGrave
+        {
+                std::unique_ptr<Socket> socket;
+                std::unique_ptr<ChainBuffer> buffer;
+                Timestamp deadline;
+        };
 
         using ChannelList = std::vector<Channel*>;
 
@@ -58,13 +170,45 @@ private:
         
         Timestamp pollReturnTime_; // poller返回发生事件的channels的时间点
         std::unique_ptr<Poller> poller_; // 事件分发器
+        std::unique_ptr<TimerQueue> timerQueue_; // 定时器队列 基于timerfd
+        std::unique_ptr<TimingWheel> timingWheel_; // 时间轮 管理连接的空闲超时
+        SlabPool* slabPool_; // 引用计数 loop析构后等缓冲区都释放了才销毁
+        std::vector<ZeroCopyGrave> zeroCopyGraves_; // 只在loop线程中访问
+        TimerId zeroCopyTimer_; // 有等待的连接时每kZeroCopyGraveCheckSeconds检查一次
+        std::atomic_int numZeroCopyGraves_; // zeroCopyGraves_的大小 给别的线程读
 
         int wakeupFd_; // 主要作用：当mainLoop获取一个新用户的channel时，通过轮询算法选择一个subloop，通过该成员唤醒subLoop处理channel
         std::unique_ptr<Channel> wakeupChannel_; // 用于唤醒subLoop的channel
 
         ChannelList activeChannels_; // 保存发生事件的channel
 
+        std::vector<Functor> afterDispatch_;        // 只在loop线程中访问
+        std::vector<Functor> runningAfterDispatch_; // 复用容量
+        std::vector<Functor> nextIteration_;        // 只在loop线程中访问
+        std::vector<Functor> runningNextIteration_; // 本轮要执行的 复用容量
+
+        // 一个优先级的任务队列
+        struct PendingQueue
+        {
+                PendingQueue() : next(0), carried(0), executed(0), carryOvers(0) {}
+
+                MpscQueue<Functor> queue;         // 无锁的多生产者单消费者队列
+                std::vector<Functor> running;     // 从队列中取出、等待执行的任务 复用容量
+                size_t next;                      // running中下一个要执行的任务
+                std::atomic<size_t> carried;      // 留到下一轮的任务数
+                std::atomic<uint64_t> executed;
+                std::atomic<uint64_t> carryOvers;
+        };
+
         std::atomic_bool callingPendingFunctors_; // 标记当前loop是否有需要执行的回调函数
-        std::vector<Functor> pendingFunctors_; // 保存需要在loop中执行的回调函数
-        std::mutex mutex_; // 互斥锁，用来保护上面vector容器的线程安全操作
+        PendingQueue pendingFunctors_[kNumPriorities]; // 保存需要在loop中执行的回调函数 按优先级分开
+        std::atomic_int maxFunctorsPerLoop_; // 每轮执行任务的个数预算
+        std::atomic<int64_t> maxFunctorMicrosPerLoop_; // 每轮执行任务的时间预算
+
+        EventLoopMetrics metrics_; // 运行统计 只有loop线程写
+        std::atomic_int numConnections_; // 归属于本loop的连接数
+        std::atomic_bool retired_; // 已经从线程池中移除
+        std::atomic_bool wakeupPending_; // 已经写过wakeupFd_但loop还没有读 其他线程不必再写
+
+        std::atomic<int64_t> busyPollMicros_; // 忙轮询的spin预算
 };
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "EventLoopMetrics.h"
+
+Log2Histogram::Log2Histogram()
+        : count_(0)
+        , sum_(0)
+        , max_(0)
+{
+        for (int i = 0; i < kBuckets; ++i)
+        {
+                buckets_[i].store(0, std::memory_order_relaxed);
+        }
+}
+
+Log2Histogram::Snapshot Log2Histogram::snapshot() const
+{
+        Snapshot snap;
+        snap.count = count_.load(std::memory_order_relaxed);
+        snap.sum = sum_.load(std::memory_order_relaxed);
+        snap.max = max_.load(std::memory_order_relaxed);
+        for (int i = 0; i < kBuckets; ++i)
+        {
+                snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        }
+        return snap;
+}
+
+uint64_t Log2Histogram::Snapshot::percentile(double p) const
+{
+        // 各个桶是分别读的 总数以桶的和为准
+        uint64_t total = 0;
+        for (int i = 0; i < kBuckets; ++i)
+        {
+                total += buckets[i];
+        }
+        if (total == 0)
+        {
+                return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * total);
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i)
+        {
+                seen += buckets[i];
+                if (seen > rank)
+                {
+                        uint64_t upper = i == 0 ? 0 : (1ULL << i) - 1;
+                        return upper < max ? upper : max;
+                }
+        }
+        return max;
+}
+
+EventLoopMetrics::EventLoopMetrics()
+        : iterations_(0)
+        , events_(0)
+        , wakeups_(0)
+        , loadPermille_(0)
+{
+}
+
+EventLoopMetrics::Snapshot EventLoopMetrics::snapshot() const
+{
+        Snapshot snap;
+        snap.iterations = iterations_.load(std::memory_order_relaxed);
+        snap.events = events_.load(std::memory_order_relaxed);
+        snap.wakeups = wakeups_.load(std::memory_order_relaxed);
+        snap.pollWaitMicros = pollWaitMicros_.snapshot();
+        snap.dispatchMicros = dispatchMicros_.snapshot();
+        snap.functorMicros = functorMicros_.snapshot();
+        snap.eventsPerIteration = eventsPerIteration_.snapshot();
+        snap.pendingDepth = pendingDepth_.snapshot();
+        snap.loadPermille = recentLoadPermille();
+        return snap;
+}
+
+double EventLoopMetrics::Snapshot::busyRatio() const
+{
+        double busy = static_cast<double>(dispatchMicros.sum + functorMicros.sum);
+        double total = busy + static_cast<double>(pollWaitMicros.sum);
+        return total > 0 ? busy / total : 0.0;
+}
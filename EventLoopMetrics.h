@@ -0,0 +1,134 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * EventLoop的运行统计
+ * 只有loop线程写 用relaxed的load+store代替原子的读改写 写的开销和普通变量差不多
+ * 其他线程随时可以读 读到的是某个时刻附近的近似值 不需要停下loop
+*/
+
+// 以2为底的对数直方图 第0个桶统计0 第i个桶统计[2^(i-1), 2^i)
+class Log2Histogram : noncopyable
+{
+public:
+        static const int kBuckets = 32;
+
+        struct Snapshot
+        {
+                uint64_t count;
+                uint64_t sum;
+                uint64_t max;
+                uint64_t buckets[kBuckets];
+
+                double mean() const { return count == 0 ? 0.0 : static_cast<double>(sum) / count; }
+                // 第p百分位所在桶的上界 p取值0~100
+                uint64_t percentile(double p) const;
+        };
+
+        Log2Histogram();
+
+        void record(uint64_t value)
+        {
+                increment(buckets_[bucketOf(value)], 1);
+                increment(count_, 1);
+                increment(sum_, value);
+                if (value > max_.load(std::memory_order_relaxed))
+                {
+                        max_.store(value, std::memory_order_relaxed);
+                }
+        }
+
+        Snapshot snapshot() const;
+
+        // 单写者计数 只有一个线程写时不需要lock前缀的指令
+        static void increment(std::atomic<uint64_t>& counter, uint64_t n)
+        {
+                counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+private:
+        static int bucketOf(uint64_t value)
+        {
+                int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+                return bucket < kBuckets ? bucket : kBuckets - 1;
+        }
+
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> sum_;
+        std::atomic<uint64_t> max_;
+        std::atomic<uint64_t> buckets_[kBuckets];
+};
+
+class EventLoopMetrics : noncopyable
+{
+public:
+        struct Snapshot
+        {
+                uint64_t iterations;  // 循环的轮数
+                uint64_t events;      // 累计处理的IO事件数
+                uint64_t wakeups;     // 通过wakeupFd_被唤醒的次数
+                Log2Histogram::Snapshot pollWaitMicros;       // 每轮在poll中等待的时间（包括忙轮询）
+                Log2Histogram::Snapshot dispatchMicros;       // 每轮在Channel::handleEvent中的时间
+                Log2Histogram::Snapshot functorMicros;        // 每轮在doPendingFunctors中的时间
+                Log2Histogram::Snapshot eventsPerIteration;   // 每轮poll返回的事件数
+                Log2Histogram::Snapshot pendingDepth;         // 每轮开始执行任务时队列中的任务数
+                uint32_t loadPermille;                        // 最近一段时间的忙碌程度 见recentLoadPermille()
+
+                // 处理IO和任务的时间占整个运行时间的比例 接近1说明这个loop已经饱和
+                double busyRatio() const;
+        };
+
+        EventLoopMetrics();
+
+        // 一轮循环结束时由loop线程调用 时间单位都是微秒
+        void recordIteration(int64_t pollWait, int64_t dispatch, int64_t functors, size_t numEvents, size_t depth)
+        {
+                Log2Histogram::increment(iterations_, 1);
+                Log2Histogram::increment(events_, numEvents);
+                pollWaitMicros_.record(clamp(pollWait));
+                dispatchMicros_.record(clamp(dispatch));
+                functorMicros_.record(clamp(functors));
+                eventsPerIteration_.record(numEvents);
+                pendingDepth_.record(depth);
+                updateLoad(pollWait, dispatch + functors);
+        }
+        void recordWakeup() { Log2Histogram::increment(wakeups_, 1); }
+
+        // 可以在任意线程调用
+        Snapshot snapshot() const;
+
+        // 最近若干轮中处理IO和任务的时间占比的指数移动平均 千分比 给负载均衡用
+        uint32_t recentLoadPermille() const { return loadPermille_.load(std::memory_order_relaxed); }
+
+private:
+        // 每轮的忙碌比例以1/8的权重并入平均值
+        void updateLoad(int64_t wait, int64_t busy)
+        {
+                int64_t total = (wait > 0 ? wait : 0) + (busy > 0 ? busy : 0);
+                if (total <= 0)
+                {
+                        return;
+                }
+                int64_t ratio = (busy > 0 ? busy : 0) * 1000 / total;
+                int64_t load = loadPermille_.load(std::memory_order_relaxed);
+                loadPermille_.store(static_cast<uint32_t>(load + (ratio - load) / 8), std::memory_order_relaxed);
+        }
+
+        // 时钟回拨之类的情况下不记负数
+        static uint64_t clamp(int64_t micros) { return micros > 0 ? static_cast<uint64_t>(micros) : 0; }
+
+        std::atomic<uint64_t> iterations_;
+        std::atomic<uint64_t> events_;
+        std::atomic<uint64_t> wakeups_;
+        Log2Histogram pollWaitMicros_;
+        Log2Histogram dispatchMicros_;
+        Log2Histogram functorMicros_;
+        Log2Histogram eventsPerIteration_;
+        Log2Histogram pendingDepth_;
+        std::atomic<uint32_t> loadPermille_;
+};
@@ -1,5 +1,6 @@
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "CpuTopology.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb, 
         const std::string& name)
@@ -9,6 +10,8 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
         , mutex_()
         , cond_()
         , callback_(cb)
+        , cpu_(-1)
+        , node_(-1)
 {
 
 }
@@ -42,6 +45,16 @@ EventLoop* EventLoopThread::startLoop()
 // 这个函数是在新线程中执行的
 void EventLoopThread::threadFunc()
 {
+        // 先确定位置再创建EventLoop 这样loop的内存在第一次访问时就落在本节点上
+        if (cpu_ >= 0)
+        {
+                CpuTopology::pinCurrentThread(cpu_);
+        }
+        if (node_ >= 0)
+        {
+                CpuTopology::preferMemoryNode(node_);
+        }
+
         EventLoop loop; // 创建一个独立的EventLoop和上面的线程一一对应， one loop per thread
 
         if (callback_)
@@ -19,6 +19,10 @@ public:
 
         EventLoop* startLoop();
 
+        // 线程启动后、创建EventLoop之前绑定到cpu上 并让它的内存优先从node上分配 需要在startLoop之前设置
+        // EventLoop本身和之后loop线程中分配的缓冲区都在这个节点上 -1表示不设置
+        void setPlacement(int cpu, int node) { cpu_ = cpu; node_ = node; }
+
 private:
         void threadFunc();
 
@@ -28,4 +32,6 @@ private:
         std::mutex mutex_;
         std::condition_variable cond_;
         ThreadInitCallback callback_;
+        int cpu_;
+        int node_;
 };
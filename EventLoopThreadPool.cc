@@ -1,5 +1,8 @@
 #include "EventLoopThreadPool.h"
 #include "EventLoopThread.h"
+#include "EventLoop.h"
+#include "CpuTopology.h"
+#include "Logger.h"
 
 #include <memory>
 
@@ -10,6 +13,8 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop,
         , started_(false)
         , numThreads_(0)
         , next_(0)
+        , placement_(kPlaceNone)
+        , nextIndex_(0)
 {
 
 }
@@ -20,14 +25,16 @@ EventLoopThreadPool::~EventLoopThreadPool()
 void EventLoopThreadPool::start(const ThreadInitCallback& cb)
 {
         started_ = true;
+        initCallback_ = cb;
 
+        std::vector<int> cpus = placementCpus();
         for (int i = 0; i < numThreads_; ++i)
         {
-                char buf[name_.size() + 32];
-                snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-                EventLoopThread* t = new EventLoopThread(cb, buf);
+                EventLoopThread* t = newThread(nextIndex_++, cpus);
+                EventLoop* loop = t->startLoop(); // 底层创建线程，绑定一个新的EventLoop，并返回该loop的地址
+                std::lock_guard<std::mutex> lock(mutex_);
                 threads_.push_back(std::unique_ptr<EventLoopThread>(t));
-                loops_.push_back(t->startLoop()); // 底层创建线程，绑定一个新的EventLoop，并返回该loop的地址
+                loops_.push_back(loop);
         }
 
         // 整个服务端只有一个线程，运行者baseLoop
@@ -37,32 +44,152 @@ void EventLoopThreadPool::start(const ThreadInitCallback& cb)
         }
 }
 
+EventLoopThread* EventLoopThreadPool::newThread(int index, const std::vector<int>& cpus)
+{
+        char nameBuf[name_.size() + 32];
+        snprintf(nameBuf, sizeof nameBuf, "%s%d", name_.c_str(), index);
+        EventLoopThread* t = new EventLoopThread(initCallback_, nameBuf);
+        if (!cpus.empty())
+        {
+                int cpu = cpus[index % cpus.size()];
+                t->setPlacement(cpu, CpuTopology::nodeOfCpu(cpu));
+                LOG_INFO("EventLoopThreadPool [%s] thread %s on cpu %d \n", name_.c_str(), nameBuf, cpu);
+        }
+        return t;
+}
+
+EventLoop* EventLoopThreadPool::addLoop()
+{
+        if (!started_)
+        {
+                LOG_ERROR("EventLoopThreadPool [%s] addLoop before start \n", name_.c_str());
+                return nullptr;
+        }
+        EventLoopThread* t = newThread(nextIndex_++, placementCpus());
+        EventLoop* loop = t->startLoop();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(std::unique_ptr<EventLoopThread>(t));
+        loops_.push_back(loop);
+        numThreads_ = static_cast<int>(loops_.size());
+        return loop;
+}
+
+std::unique_ptr<EventLoopThread> EventLoopThreadPool::removeLoop(EventLoop* loop)
+{
+        std::unique_ptr<EventLoopThread> thread;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < loops_.size(); ++i)
+        {
+                if (loops_[i] == loop)
+                {
+                        thread = std::move(threads_[i]);
+                        threads_.erase(threads_.begin() + i);
+                        loops_.erase(loops_.begin() + i);
+                        numThreads_ = static_cast<int>(loops_.size());
+                        break;
+                }
+        }
+        return thread;
+}
+
+size_t EventLoopThreadPool::numLoops() const
+{
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loops_.size();
+}
+
+std::vector<int> EventLoopThreadPool::placementCpus() const
+{
+        std::vector<int> cpus;
+        switch (placement_)
+        {
+        case kPlaceCpuList:
+                cpus = cpus_;
+                break;
+        case kPlacePhysicalCores:
+                cpus = CpuTopology::physicalCores();
+                break;
+        case kPlaceNumaSpread:
+        {
+                // 第i个loop放在第i % n个节点上 同一节点上的loop依次使用该节点的CPU
+                std::vector<std::vector<int>> nodes = CpuTopology::numaNodes();
+                for (size_t round = 0; cpus.size() < static_cast<size_t>(numThreads_); ++round)
+                {
+                        bool any = false;
+                        for (const std::vector<int>& nodeCpus : nodes)
+                        {
+                                if (round < nodeCpus.size())
+                                {
+                                        cpus.push_back(nodeCpus[round]);
+                                        any = true;
+                                }
+                        }
+                        if (!any)
+                        {
+                                break; // 线程比CPU多 剩下的循环使用
+                        }
+                }
+                break;
+        }
+        case kPlaceNone:
+                break;
+        }
+        return cpus;
+}
+
 // 如果工作在多线程中， baseLoop会默认以轮询的方式分配channel给subloop
 EventLoop* EventLoopThreadPool::getNextLoop()
 {
         EventLoop* loop = baseLoop_;
 
+        std::lock_guard<std::mutex> lock(mutex_);
         if (!loops_.empty())  // 通过轮询获取下一个处理事件的loop
         {
-                loop = loops_[next_];
-                ++next_;
                 if (static_cast<size_t>(next_) >= loops_.size())
                 {
-                        next_ = 0;
+                        next_ = 0; // 运行时移除过loop
                 }
+                loop = loops_[next_];
+                ++next_;
         }
 
         return loop;
 }
 
+EventLoop* EventLoopThreadPool::getLoopForConnection(const InetAddress& peerAddr)
+{
+        if (!selector_)
+        {
+                return getNextLoop();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (loops_.empty())
+        {
+                return baseLoop_;
+        }
+        return selector_->select(loops_, peerAddr);
+}
+
 std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
 {
+        std::lock_guard<std::mutex> lock(mutex_);
         if (loops_.empty())
         {
                 return std::vector<EventLoop*>(1, baseLoop_);
         }
         else
         {
-                loops_;
+                return loops_;
         }
-}
\ No newline at end of file
+}
+
+std::vector<EventLoopMetrics::Snapshot> EventLoopThreadPool::metricsSnapshot()
+{
+        std::vector<EventLoopMetrics::Snapshot> snapshots;
+        for (EventLoop* loop : getAllLoops())
+        {
+                snapshots.push_back(loop->metrics());
+        }
+        return snapshots;
+}
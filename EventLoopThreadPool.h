@@ -1,12 +1,15 @@
 #pragma once
 
 #include "EventLoopThread.h"
+#include "EventLoopMetrics.h"
+#include "LoopSelector.h"
 #include "noncopyable.h"
 
 #include <functional>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 class EventLoop;
 
@@ -15,27 +18,72 @@ class EventLoopThreadPool : noncopyable
 public:
         using ThreadInitCallback = std::function<void(EventLoop*)>;
 
+        // loop线程的放置策略
+        enum Placement
+        {
+                kPlaceNone,          // 默认 由调度器决定
+                kPlaceCpuList,       // 依次绑定到给定的CPU上 线程多于CPU时循环使用
+                kPlacePhysicalCores, // 每个物理核一个loop 不和超线程兄弟共享核心
+                kPlaceNumaSpread,    // 轮流放到各个NUMA节点上 内存也从所在节点分配
+        };
+
         EventLoopThreadPool(EventLoop *baseLoop, const std::string& nameArg);
         ~EventLoopThreadPool();
 
         void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
+        // 设置放置策略 需要在start之前调用 cpus只在kPlaceCpuList时使用
+        // 除kPlaceNone外 每个loop线程都绑定到一个CPU上 并优先从该CPU所在的NUMA节点分配内存
+        void setPlacement(Placement placement, const std::vector<int>& cpus = std::vector<int>())
+        {
+                placement_ = placement;
+                cpus_ = cpus;
+        }
+
         void start(const ThreadInitCallback& cb = ThreadInitCallback());
 
+        // 运行时增加一个subloop 需要在start之后调用 新loop沿用start时的初始化回调和放置策略
+        // 返回新loop 它立即参与新连接的分配
+        EventLoop *addLoop();
+        // 把loop从线程池中移除 返回它所在的线程 之后不会再有新连接分给它
+        // 调用者负责把loop上的连接迁走 之后析构返回值 loop线程随之退出
+        std::unique_ptr<EventLoopThread> removeLoop(EventLoop *loop);
+        size_t numLoops() const;
+
         // 如果工作在多线程中， baseLoop会默认以轮询的方式分配channel给subloop
         EventLoop *getNextLoop();
 
+        // 为来自peerAddr的新连接选择一个loop 没有设置选择策略时和getNextLoop()一样轮询
+        EventLoop *getLoopForConnection(const InetAddress& peerAddr);
+
+        // 设置subloop的选择策略 接管selector的所有权
+        void setLoopSelector(LoopSelector* selector) { selector_.reset(selector); }
+
         std::vector<EventLoop*> getAllLoops();
 
+        // 所有loop的运行统计 顺序和getAllLoops()一致 各个loop照常运行 不需要停下来
+        std::vector<EventLoopMetrics::Snapshot> metricsSnapshot();
+
         bool started() const { return started_; }
         const std::string& name() const { return name_; }
 private:
+        // 按放置策略给每个loop分配的CPU 空表示不绑定
+        std::vector<int> placementCpus() const;
+        EventLoopThread *newThread(int index, const std::vector<int>& cpus);
 
         EventLoop *baseLoop_; // EventLoop loop
         std::string name_;
         bool started_;
         int numThreads_;
         int next_;
-        std::vector<std::unique_ptr<EventLoopThread>> threads_; // 包含了所有线程
+        Placement placement_;
+        std::vector<int> cpus_;
+        ThreadInitCallback initCallback_; // 运行时增加的loop也要执行
+        int nextIndex_; // 下一个线程名的编号 移除过loop之后也不会重名
+
+        // 运行时可以增删loop 其他线程可能同时在读getAllLoops()
+        mutable std::mutex mutex_;
+        std::vector<std::unique_ptr<EventLoopThread>> threads_; // 包含了所有线程 和loops_一一对应
         std::vector<EventLoop*> loops_; // 包含了线程循环的指针
+        std::unique_ptr<LoopSelector> selector_; // subloop的选择策略
 };
\ No newline at end of file
@@ -0,0 +1,849 @@
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <unistd.h>
+#include <strings.h>
+#include <errno.h>
+
+// channel 未添加到poller中
+static const int kNew = -1;
+// channel 已经添加到poller中
+static const int kAdded = 1;
+// channel 在poller中 但没有关注任何事件
+static const int kDeleted = 2;
+
+// POLL_REMOVE、ASYNC_CANCEL请求自身的完成事件不需要处理
+static const uint64_t kIgnoredUserData = ~0ULL;
+// user_data的最高两位区分POLL_ADD、多次触发的recv/accept和WRITEV
+static const uint64_t kCompletionBit = 1ULL << 63;
+static const uint64_t kWriteBit = 1ULL << 62;
+static const uint32_t kGenerationMask = 0x3fffffff;
+// 缓冲区环的组号
+static const uint16_t kRecvBufferGroup = 0;
+
+// io_uring的poll请求只认识这些事件 EPOLLET等epoll专用的标志需要去掉
+static const int kPollMask = EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLRDHUP;
+
+static uint64_t makeUserData(uint64_t kind, uint32_t generation, int fd)
+{
+        return kind
+                | (static_cast<uint64_t>(generation & kGenerationMask) << 32)
+                | static_cast<uint32_t>(fd);
+}
+
+static int ioUringSetup(unsigned entries, io_uring_params* p)
+{
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argsz)
+{
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argsz));
+}
+
+static int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs)
+{
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+IoUringPoller::IoUringPoller(EventLoop* loop)
+        : Poller(loop)
+        , ringfd_(-1)
+        , sqRing_(MAP_FAILED)
+        , sqRingSize_(0)
+        , sqesSize_(0)
+        , sqLocalTail_(0)
+        , toSubmit_(0)
+        , cqRing_(MAP_FAILED)
+        , cqRingSize_(0)
+        , bufRing_(nullptr)
+        , bufRingTail_(nullptr)
+        , bufRingLocalTail_(0)
+        , recvBuffers_(nullptr)
+        , recvCompletion_(false)
+        , acceptCompletion_(false)
+        , round_(0)
+{
+        if (!setupRing())
+        {
+                LOG_ERROR("IoUringPoller: io_uring is not available, errno:%d \n", errno);
+        }
+        else if (setupBufferRing())
+        {
+                recvCompletion_ = true;
+                acceptCompletion_ = true;
+        }
+        else
+        {
+                LOG_INFO("IoUringPoller: provided buffer rings unsupported, errno:%d, use poll requests only \n", errno);
+        }
+}
+
+IoUringPoller::~IoUringPoller()
+{
+        // 先关闭ring 内核取消所有请求之后才能释放交给它的缓冲区
+        if (ringfd_ >= 0)
+        {
+                ::close(ringfd_);
+        }
+        if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+        {
+                ::munmap(cqRing_, cqRingSize_);
+        }
+        if (sqRing_ != MAP_FAILED)
+        {
+                ::munmap(sqRing_, sqRingSize_);
+        }
+        if (sqesSize_ > 0)
+        {
+                ::munmap(sqes_, sqesSize_);
+        }
+        if (recvBuffers_ != nullptr)
+        {
+                ::munmap(recvBuffers_, kRecvBuffers * kRecvBufferSize);
+        }
+        if (bufRing_ != nullptr)
+        {
+                ::munmap(bufRing_, kRecvBuffers * sizeof(io_uring_buf));
+        }
+        for (PollState& state : states_)
+        {
+                delete[] state.writeVecs;
+        }
+}
+
+bool IoUringPoller::setupRing()
+{
+        io_uring_params params;
+        bzero(&params, sizeof(params));
+        // 只由loop线程提交 完成任务推迟到io_uring_enter时执行(6.1) 省掉打断用户态的task_work
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        params.cq_entries = kCompletionEntries;
+
+        int fd = ioUringSetup(kSubmissionEntries, &params);
+        if (fd < 0 && errno == EINVAL)
+        {
+                // 老内核不认识这两个标志
+                bzero(&params, sizeof(params));
+                params.flags = IORING_SETUP_CQSIZE;
+                params.cq_entries = kCompletionEntries;
+                fd = ioUringSetup(kSubmissionEntries, &params);
+        }
+        if (fd < 0)
+        {
+                return false;
+        }
+        // 带超时的等待需要EXT_ARG(5.11) CQ满时不丢事件需要NODROP
+        if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+        {
+                ::close(fd);
+                errno = ENOSYS;
+                return false;
+        }
+
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap && cqRingSize_ > sqRingSize_)
+        {
+                sqRingSize_ = cqRingSize_;
+        }
+
+        sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED)
+        {
+                ::close(fd);
+                return false;
+        }
+        if (singleMmap)
+        {
+                cqRing_ = sqRing_;
+        }
+        else
+        {
+                cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+                if (cqRing_ == MAP_FAILED)
+                {
+                        ::close(fd);
+                        return false;
+                }
+        }
+        void* sqes = ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+                ::close(fd);
+                return false;
+        }
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sqRing_);
+        sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqLocalTail_ = *sqTail_;
+
+        char* cq = static_cast<char*>(cqRing_);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        ringfd_ = fd;
+        return true;
+}
+
+bool IoUringPoller::setupBufferRing()
+{
+        // 环本身 每个元素16字节 需要按页对齐
+        void* ring = ::mmap(nullptr, kRecvBuffers * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (ring == MAP_FAILED)
+        {
+                return false;
+        }
+        void* buffers = ::mmap(nullptr, kRecvBuffers * kRecvBufferSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffers == MAP_FAILED)
+        {
+                ::munmap(ring, kRecvBuffers * sizeof(io_uring_buf));
+                return false;
+        }
+
+        io_uring_buf_reg reg;
+        bzero(&reg, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+        reg.ring_entries = kRecvBuffers;
+        reg.bgid = kRecvBufferGroup;
+        if (ioUringRegister(ringfd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        {
+                int savedErrno = errno;
+                ::munmap(buffers, kRecvBuffers * kRecvBufferSize);
+                ::munmap(ring, kRecvBuffers * sizeof(io_uring_buf));
+                errno = savedErrno;
+                return false;
+        }
+
+        bufRing_ = static_cast<io_uring_buf*>(ring);
+        bufRingTail_ = &bufRing_[0].resv;
+        recvBuffers_ = static_cast<char*>(buffers);
+        for (unsigned bid = 0; bid < kRecvBuffers; ++bid)
+        {
+                recycleBuffer(static_cast<uint16_t>(bid));
+        }
+        return true;
+}
+
+void IoUringPoller::recycleBuffer(uint16_t bid)
+{
+        io_uring_buf* buf = &bufRing_[bufRingLocalTail_ & (kRecvBuffers - 1)];
+        buf->addr = reinterpret_cast<uint64_t>(recvBuffer(bid));
+        buf->len = kRecvBufferSize;
+        buf->bid = bid;
+        ++bufRingLocalTail_;
+        // 填好元素之后再发布tail
+        __atomic_store_n(bufRingTail_, bufRingLocalTail_, __ATOMIC_RELEASE);
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList* activeChannels)
+{
+        // 每轮循环都会调用 忙轮询模式下更是频繁 只输出DEBUG日志
+        LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, numChannels());
+
+        ++round_;
+        rearmFired();
+        submitWrites();
+
+        // 上一轮同步取消时收割到的事件还没处理 不阻塞
+        if (!deferred_.empty())
+        {
+                timeoutMs = 0;
+        }
+
+        // 提交本轮积攒的所有SQE 并等待至少一个完成事件 只需要一次系统调用
+        struct __kernel_timespec ts;
+        io_uring_getevents_arg arg;
+        bzero(&arg, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeoutMs >= 0)
+        {
+                ts.tv_sec = timeoutMs / 1000;
+                ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+                arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+
+        int ret = enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        int saveErrno = errno;
+        Timestamp now(Timestamp::now());
+
+        size_t numBefore = activeChannels->size();
+        reapCompletions(activeChannels);
+        size_t numEvents = activeChannels->size() - numBefore;
+
+        if (numEvents > 0)
+        {
+                LOG_DEBUG("%lu events happened \n", numEvents);
+        }
+        else if (ret < 0 && saveErrno != EINTR && saveErrno != ETIME)
+        {
+                errno = saveErrno;
+                LOG_ERROR("IoUringPoller::poll() err:%d \n", saveErrno);
+        }
+        else
+        {
+                LOG_DEBUG("%s timeout! \n", __FUNCTION__);
+        }
+        return now;
+}
+
+int IoUringPoller::enter(unsigned minComplete, unsigned flags, void* arg, size_t argsz)
+{
+        __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+        int ret = ioUringEnter(ringfd_, toSubmit_, minComplete, flags, arg, argsz);
+        // 内核没有取走的SQE留到下一次提交
+        toSubmit_ = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        return ret;
+}
+
+void IoUringPoller::updateChannel(Channel* channel)
+{
+        const int index = channel->index();
+        const int fd = channel->fd();
+        LOG_DEBUG("func=%s => fd = %d events = %d index = %d\n",  __FUNCTION__, fd, channel->events(), index);
+
+        countInterestUpdate();
+        if (index == kNew)
+        {
+                insertChannel(channel);
+                channel->setWritesByCompletion(channel->hasWriteCompletion());
+        }
+
+        const unsigned sqTailBefore = sqLocalTail_;
+        if (channel->isNoneEvent())
+        {
+                disarmPoll(fd);
+                disarmCompletion(fd, channel);
+                disarmWrite(fd, channel);
+                channel->set_index(kDeleted);
+        }
+        else
+        {
+                channel->set_index(kAdded);
+                arm(channel);
+        }
+        countInterestKernelOps(sqLocalTail_ - sqTailBefore);
+}
+
+void IoUringPoller::removeChannel(Channel* channel)
+{
+        int fd = channel->fd();
+        eraseChannel(fd);
+
+        LOG_INFO("func=%s => fd = %d\n", __FUNCTION__, fd);
+
+        countInterestUpdate();
+        const unsigned sqTailBefore = sqLocalTail_;
+        disarmPoll(fd);
+        disarmCompletion(fd, channel);
+        disarmWrite(fd, channel);
+        countInterestKernelOps(sqLocalTail_ - sqTailBefore);
+        channel->setWritesByCompletion(false);
+        channel->set_index(kNew);
+}
+
+IoUringPoller::PollState& IoUringPoller::stateOf(int fd)
+{
+        if (static_cast<size_t>(fd) >= states_.size())
+        {
+                PollState empty = { 0, 0, false, false, 0, 0, false, false, false, 0, nullptr };
+                states_.resize(fd + 1, empty);
+        }
+        return states_[fd];
+}
+
+io_uring_sqe* IoUringPoller::getSqe()
+{
+        // SQ满了 先把已经填好的SQE提交掉
+        if (sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+        {
+                if (enter(0, 0, nullptr, 0) < 0)
+                {
+                        LOG_FATAL("io_uring_enter submit error:%d \n", errno);
+                }
+        }
+
+        unsigned index = sqLocalTail_ & sqMask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        bzero(sqe, sizeof(*sqe));
+        sqArray_[index] = index;
+        ++sqLocalTail_;
+        ++toSubmit_;
+        return sqe;
+}
+
+bool IoUringPoller::usesCompletion(Channel* channel) const
+{
+        if (!channel->isReading())
+        {
+                return false;
+        }
+        switch (channel->completionOp())
+        {
+        case Channel::kRecvCompletion:
+                return recvCompletion_;
+        case Channel::kAcceptCompletion:
+                return acceptCompletion_;
+        default:
+                return false;
+        }
+}
+
+bool IoUringPoller::usesWriteCompletion(Channel* channel) const
+{
+        return channel->isWriting() && channel->writesByCompletion();
+}
+
+int IoUringPoller::pollEventsOf(Channel* channel, const PollState& state) const
+{
+        int events = channel->events() & kPollMask;
+        if (usesCompletion(channel))
+        {
+                events &= ~(EPOLLIN | EPOLLPRI);
+        }
+        if (usesWriteCompletion(channel) && !state.writePolled)
+        {
+                events &= ~EPOLLOUT;
+        }
+        return events;
+}
+
+bool IoUringPoller::needsPoll(Channel* channel, int events) const
+{
+        // 连接上没有写事件时也等一个空的poll 零拷贝发送的完成通知和错误通过POLLERR报告
+        return events != 0 || (usesCompletion(channel) && channel->completionOp() == Channel::kRecvCompletion);
+}
+
+void IoUringPoller::arm(Channel* channel)
+{
+        const int fd = channel->fd();
+        PollState& state = stateOf(fd);
+        if (!usesCompletion(channel))
+        {
+                disarmCompletion(fd, channel);
+        }
+        else if (!state.completionArmed)
+        {
+                submitCompletion(fd, channel->completionOp());
+        }
+
+        if (!usesWriteCompletion(channel))
+        {
+                disarmWrite(fd, channel);
+                state.writePolled = false;
+        }
+        else if (!state.writeArmed && !state.writeQueued && !state.writePolled)
+        {
+                // 等到poll时再收集数据 本轮之后追加的数据也能一起发出
+                state.writeQueued = true;
+                pendingWrites_.push_back(fd);
+        }
+
+        // 内核中已经是同样的请求就不需要重新提交
+        const int events = pollEventsOf(channel, state);
+        const bool poll = needsPoll(channel, events);
+        if (state.pollArmed && (!poll || state.armedEvents != events))
+        {
+                disarmPoll(fd);
+        }
+        if (poll && !state.pollArmed)
+        {
+                submitPollAdd(fd, events);
+        }
+}
+
+void IoUringPoller::submitPollAdd(int fd, int events)
+{
+        PollState& state = stateOf(fd);
+        state.armedEvents = events;
+        state.pollArmed = true;
+
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = static_cast<uint32_t>(events);
+        sqe->user_data = makeUserData(0, state.pollGeneration, fd);
+}
+
+void IoUringPoller::submitCompletion(int fd, Channel::CompletionOp op)
+{
+        PollState& state = stateOf(fd);
+        state.completionArmed = true;
+
+        io_uring_sqe* sqe = getSqe();
+        sqe->fd = fd;
+        if (op == Channel::kRecvCompletion)
+        {
+                // 不指定缓冲区 每次从缓冲区环中取一个
+                sqe->opcode = IORING_OP_RECV;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = kRecvBufferGroup;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+        }
+        else
+        {
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+                sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        }
+        sqe->user_data = makeUserData(kCompletionBit, state.completionGeneration, fd);
+}
+
+void IoUringPoller::submitWrites()
+{
+        for (size_t i = 0; i < pendingWrites_.size(); ++i)
+        {
+                const int fd = pendingWrites_[i];
+                Channel* channel = findChannel(fd);
+                PollState& state = states_[fd];
+                state.writeQueued = false;
+                if (channel == nullptr || !usesWriteCompletion(channel) || state.writeArmed || state.writePolled)
+                {
+                        continue;
+                }
+                if (state.writeVecs == nullptr)
+                {
+                        state.writeVecs = new struct iovec[kWriteIovecs];
+                }
+                int iovcnt = channel->gather(state.writeVecs, kWriteIovecs);
+                if (iovcnt <= 0)
+                {
+                        // 链首是文件段之类 等可写事件 由writeCallback自己发送
+                        state.writePolled = true;
+                        arm(channel);
+                        continue;
+                }
+                state.writeArmed = true;
+
+                io_uring_sqe* sqe = getSqe();
+                sqe->opcode = IORING_OP_WRITEV;
+                sqe->fd = fd;
+                sqe->addr = reinterpret_cast<uint64_t>(state.writeVecs);
+                sqe->len = static_cast<uint32_t>(iovcnt);
+                sqe->off = static_cast<uint64_t>(-1); // 不是文件 没有偏移
+                sqe->user_data = makeUserData(kWriteBit, state.writeGeneration, fd);
+        }
+        pendingWrites_.clear();
+}
+
+void IoUringPoller::disarmPoll(int fd)
+{
+        PollState& state = stateOf(fd);
+        if (state.pollArmed)
+        {
+                io_uring_sqe* sqe = getSqe();
+                sqe->opcode = IORING_OP_POLL_REMOVE;
+                sqe->fd = -1;
+                sqe->addr = makeUserData(0, state.pollGeneration, fd);
+                sqe->user_data = kIgnoredUserData;
+
+                state.pollArmed = false;
+                state.armedEvents = 0;
+                ++state.pollGeneration;
+        }
+}
+
+/*
+ * 多次触发的recv被取消之前可能已经把数据收进了缓冲区环 这些数据已经不在socket中了 不能丢
+ * 所以同步等到它的最后一个完成事件 期间收到的数据都交给channel 其他fd的完成事件留到下一次poll处理
+ * 只在关闭、迁移连接时发生 和epoll下的一次epoll_ctl(DEL)一样是一次系统调用
+*/
+void IoUringPoller::disarmCompletion(int fd, Channel* channel)
+{
+        PollState& state = stateOf(fd);
+        if (!state.completionArmed)
+        {
+                return;
+        }
+        const uint64_t target = makeUserData(kCompletionBit, state.completionGeneration, fd);
+        state.completionArmed = false;
+        ++state.completionGeneration;
+        cancelAndWait(fd, target, channel);
+}
+
+/*
+ * 正在执行的WRITEV引用着channel所有者的缓冲区 取消之后同样要等它结束 可能已经写出了一部分
+ * 写出的字节数交给channel 之后缓冲区才能释放或者交给别的loop
+*/
+void IoUringPoller::disarmWrite(int fd, Channel* channel)
+{
+        PollState& state = stateOf(fd);
+        if (!state.writeArmed)
+        {
+                return;
+        }
+        const uint64_t target = makeUserData(kWriteBit, state.writeGeneration, fd);
+        state.writeArmed = false;
+        ++state.writeGeneration;
+        cancelAndWait(fd, target, channel);
+}
+
+void IoUringPoller::cancelAndWait(int fd, uint64_t target, Channel* channel)
+{
+        // 之前同步取消其他fd时可能已经把它的完成事件收进了deferred_ 按顺序先处理
+        bool finished = false;
+        size_t kept = 0;
+        for (size_t i = 0; i < deferred_.size(); ++i)
+        {
+                if (deferred_[i].userData == target)
+                {
+                        finished = drainCancelled(channel, deferred_[i]) || finished;
+                }
+                else
+                {
+                        deferred_[kept++] = deferred_[i];
+                }
+        }
+        deferred_.resize(kept);
+        if (finished)
+        {
+                return; // 请求已经结束了 不需要取消
+        }
+
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = target;
+        sqe->user_data = kIgnoredUserData;
+
+        while (!finished)
+        {
+                if (enter(1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                {
+                        LOG_ERROR("IoUringPoller::cancelAndWait fd = %d err:%d \n", fd, errno);
+                        return;
+                }
+                unsigned head = *cqHead_;
+                unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+                for (; head != tail; ++head)
+                {
+                        const io_uring_cqe* cqe = &cqes_[head & cqMask_];
+                        if (cqe->user_data == kIgnoredUserData)
+                        {
+                                continue;
+                        }
+                        Completion c = { cqe->user_data, cqe->res, cqe->flags };
+                        if (c.userData == target)
+                        {
+                                finished = drainCancelled(channel, c) || finished;
+                        }
+                        else
+                        {
+                                deferred_.push_back(c);
+                        }
+                }
+                __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        }
+}
+
+bool IoUringPoller::drainCancelled(Channel* channel, const Completion& cqe)
+{
+        if (cqe.userData & kWriteBit)
+        {
+                channel->completeWrite(cqe.res); // -ECANCELED时也交给channel 它据此知道内核不再引用缓冲区
+                return true;
+        }
+        if (cqe.flags & IORING_CQE_F_BUFFER)
+        {
+                uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                if (cqe.res > 0)
+                {
+                        channel->complete(recvBuffer(bid), cqe.res);
+                }
+                recycleBuffer(bid);
+        }
+        else if (cqe.res >= 0 && channel->completionOp() == Channel::kAcceptCompletion)
+        {
+                channel->complete(nullptr, cqe.res); // 已经接受的连接也交出去 由channel的所有者处理
+        }
+        return !(cqe.flags & IORING_CQE_F_MORE);
+}
+
+void IoUringPoller::rearmFired()
+{
+        for (int fd : fired_)
+        {
+                Channel* channel = findChannel(fd);
+                if (channel != nullptr && !channel->isNoneEvent())
+                {
+                        arm(channel); // 回调中已经通过updateChannel重新提交过的不会重复提交
+                }
+        }
+        fired_.clear();
+}
+
+void IoUringPoller::reapCompletions(ChannelList* activeChannels)
+{
+        // 先处理同步取消时留下的 它们比CQ中的更早
+        for (const Completion& c : deferred_)
+        {
+                handleCqe(c, activeChannels);
+        }
+        deferred_.clear();
+
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+                const io_uring_cqe* cqe = &cqes_[head & cqMask_];
+                if (cqe->user_data != kIgnoredUserData)
+                {
+                        Completion c = { cqe->user_data, cqe->res, cqe->flags };
+                        handleCqe(c, activeChannels);
+                }
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+void IoUringPoller::handleCqe(const Completion& cqe, ChannelList* activeChannels)
+{
+        const bool completion = cqe.userData & kCompletionBit;
+        const bool write = cqe.userData & kWriteBit;
+        const int fd = static_cast<int>(cqe.userData & 0xffffffff);
+        const uint32_t generation = static_cast<uint32_t>(cqe.userData >> 32) & kGenerationMask;
+
+        PollState* state = static_cast<size_t>(fd) < states_.size() ? &states_[fd] : nullptr;
+        if (write)
+        {
+                // 取消的WRITEV已经在disarmWrite中同步交付过了
+                if (state == nullptr || !state->writeArmed || (state->writeGeneration & kGenerationMask) != generation)
+                {
+                        return;
+                }
+                state->writeArmed = false;
+                Channel* channel = findChannel(fd);
+                if (channel != nullptr)
+                {
+                        channel->completeWrite(cqe.res);
+                        if (cqe.res != -ECANCELED)
+                        {
+                                activate(channel, *state, EPOLLOUT, activeChannels);
+                        }
+                        fired_.push_back(fd);
+                }
+                return;
+        }
+        if (completion)
+        {
+                bool current = state != nullptr
+                        && state->completionArmed
+                        && (state->completionGeneration & kGenerationMask) == generation;
+                Channel* channel = current ? findChannel(fd) : nullptr;
+                if (current && !(cqe.flags & IORING_CQE_F_MORE))
+                {
+                        state->completionArmed = false; // 多次触发的请求结束了 下一轮重新提交
+                }
+                if (channel != nullptr)
+                {
+                        handleCompletion(fd, channel, cqe, activeChannels);
+                }
+                else if (cqe.res > 0 && !(cqe.flags & IORING_CQE_F_BUFFER))
+                {
+                        // 已经取消的accept请求接受的连接没有人要了 recv的数据总是带着缓冲区
+                        ::close(cqe.res);
+                }
+                if (cqe.flags & IORING_CQE_F_BUFFER)
+                {
+                        recycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+                }
+                return;
+        }
+
+        if (state == nullptr || (state->pollGeneration & kGenerationMask) != generation || !state->pollArmed)
+        {
+                return; // 已经被取消或重新注册过的旧请求
+        }
+        state->pollArmed = false; // 一次性poll请求完成后需要重新提交
+        state->writePolled = false; // 完成式写的channel下一轮重新收集数据
+
+        Channel* channel = findChannel(fd);
+        if (channel == nullptr || cqe.res == -ECANCELED)
+        {
+                return;
+        }
+        int revents = cqe.res < 0 ? static_cast<int>(EPOLLERR) : static_cast<int>(cqe.res);
+        if (usesCompletion(channel))
+        {
+                // 读和对端关闭由recv报告 这里只关心写事件和错误 只有POLLHUP时不再等 直到关注的事件改变
+                revents &= EPOLLOUT | EPOLLERR;
+                if (revents == 0)
+                {
+                        return;
+                }
+        }
+        activate(channel, *state, revents, activeChannels);
+        fired_.push_back(fd);
+}
+
+void IoUringPoller::handleCompletion(int fd, Channel* channel, const Completion& cqe, ChannelList* activeChannels)
+{
+        const bool more = cqe.flags & IORING_CQE_F_MORE;
+        if (!more)
+        {
+                fired_.push_back(fd);
+        }
+        if (cqe.res == -ECANCELED)
+        {
+                return;
+        }
+        if (cqe.res == -ENOBUFS)
+        {
+                return; // 缓冲区环暂时用完了 请求已经结束 下一轮重新提交
+        }
+        if (cqe.res == -EINVAL)
+        {
+                // 内核不支持多次触发的recv/accept 这个poller之后都改用一次性poll 下一轮以可读事件重新提交
+                if (channel->completionOp() == Channel::kRecvCompletion)
+                {
+                        recvCompletion_ = false;
+                }
+                else
+                {
+                        acceptCompletion_ = false;
+                }
+                LOG_INFO("IoUringPoller: multishot op %d unsupported, fall back to poll requests \n", static_cast<int>(channel->completionOp()));
+                return;
+        }
+
+        if (cqe.flags & IORING_CQE_F_BUFFER)
+        {
+                channel->complete(recvBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT)), cqe.res);
+        }
+        else
+        {
+                channel->complete(nullptr, cqe.res);
+        }
+        activate(channel, states_[fd], EPOLLIN, activeChannels);
+}
+
+void IoUringPoller::activate(Channel* channel, PollState& state, int revents, ChannelList* activeChannels)
+{
+        if (state.activeRound == round_)
+        {
+                channel->set_revents(channel->revents() | revents); // 本轮已经在activeChannels中
+                return;
+        }
+        state.activeRound = round_;
+        channel->set_revents(revents);
+        activeChannels->push_back(channel);
+}
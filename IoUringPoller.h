@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Poller.h"
+#include "Channel.h"
+
+#include <vector>
+#include <stdint.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+struct iovec;
+
+/*
+ * 基于io_uring的IO复用 直接使用内核的系统调用接口 不依赖liburing
+ * 设置了完成式读的channel（TcpConnection、Acceptor）由内核直接完成读操作
+ *   连接上挂一个多次触发的IORING_OP_RECV 数据收进注册给内核的缓冲区环 收割时交给channel再把缓冲区还回环中
+ *   监听socket上挂一个多次触发的IORING_OP_ACCEPT 每个新连接一个完成事件
+ *   之后以EPOLLIN回调readCallback 回调中直接处理已经收好的数据/连接 MessageCallBack和NewConnectionCallback不变
+ * 设置了完成式写的channel（TcpConnection）关注写事件时 在poll时从它的缓冲区收集待发送的数据 提交一个IORING_OP_WRITEV
+ *   完成后把写出的字节数交给channel 再以EPOLLOUT回调writeCallback 还有数据时下一次poll再提交
+ *   所有连接的写和读、等待合并在同一次io_uring_enter中 链首是文件段等不能这样发送的数据时退回等可写事件
+ * 其他的关注事件（eventfd、timerfd等）对应一次性的IORING_OP_POLL_ADD请求 完成后在下一次poll时重新提交
+ * 一轮循环中所有的注册、修改、重新提交都先写入SQ 在poll中和等待合并成一次io_uring_enter
+ * 内核不支持缓冲区环（5.19之前）或者多次触发的recv（6.0之前）时退回一次性poll 和epoll的LT语义一致
+*/
+class IoUringPoller : public Poller
+{
+public:
+        IoUringPoller(EventLoop* loop);
+        ~IoUringPoller() override;
+
+        // 内核不支持io_uring（或缺少需要的特性）时返回false 由newDefaultPoller退回epoll
+        bool valid() const { return ringfd_ >= 0; }
+
+        // 重写基类Poller的抽象方法
+        Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
+        void updateChannel(Channel* channel) override;
+        void removeChannel(Channel* channel) override;
+private:
+        static const unsigned kSubmissionEntries = 1024;
+        static const unsigned kCompletionEntries = 4096;
+        static const unsigned kRecvBuffers = 128;          // 缓冲区环中的缓冲区数 必须是2的幂
+        static const unsigned kRecvBufferSize = 16 * 1024; // 每个缓冲区的大小 一次recv最多收这么多
+        static const int kWriteIovecs = 64;                // 一个WRITEV请求最多的段数
+
+        // 每个fd上三类请求的状态 user_data = 类型 << 62 | generation << 32 | fd
+        // 请求取消或者重新提交时generation递增 迟到的旧完成事件会因为generation不匹配被丢弃
+        struct PollState
+        {
+                uint32_t pollGeneration;
+                int armedEvents;          // 正在内核中等待的poll事件
+                bool pollArmed;           // 当前有POLL_ADD请求
+                bool completionArmed;     // 当前有多次触发的recv/accept请求
+                uint32_t completionGeneration;
+                uint32_t activeRound;     // 最近一次加入activeChannels的轮次 同一轮的多个完成事件合并
+                bool writeArmed;          // 当前有WRITEV请求
+                bool writeQueued;         // 在pendingWrites_中 等poll时收集数据提交
+                bool writePolled;         // 没有能提交的数据 改为用POLL_ADD等可写事件
+                uint32_t writeGeneration;
+                struct iovec* writeVecs;  // WRITEV请求的iovec 第一次提交时分配
+        };
+
+        // 从CQ中取出的完成事件
+        struct Completion
+        {
+                uint64_t userData;
+                int32_t res;
+                uint32_t flags;
+        };
+
+        bool setupRing();
+        // 注册缓冲区环 失败时只用一次性poll
+        bool setupBufferRing();
+        PollState& stateOf(int fd);
+        io_uring_sqe* getSqe();
+        // 提交SQ 等待至少minComplete个完成事件
+        int enter(unsigned minComplete, unsigned flags, void* arg, size_t argsz);
+
+        // channel当前是否由内核完成读操作
+        bool usesCompletion(Channel* channel) const;
+        // channel当前是否由内核完成写操作
+        bool usesWriteCompletion(Channel* channel) const;
+        // 需要POLL_ADD等待的事件 完成式读的channel只等写事件和错误 完成式写的channel不等写事件
+        int pollEventsOf(Channel* channel, const PollState& state) const;
+        bool needsPoll(Channel* channel, int events) const;
+        // 按channel当前的关注事件提交缺少的请求
+        void arm(Channel* channel);
+
+        void submitPollAdd(int fd, int events);
+        void submitCompletion(int fd, Channel::CompletionOp op);
+        // 收集pendingWrites_中各个channel待发送的数据 提交WRITEV
+        void submitWrites();
+        // 取消fd上正在等待的poll请求
+        void disarmPoll(int fd);
+        // 取消多次触发的请求并等待它结束 已经收到的数据仍然交给channel 之后不会再有数据写进channel
+        void disarmCompletion(int fd, Channel* channel);
+        // 取消正在执行的WRITEV并等待它结束 已经写出的字节数交给channel
+        void disarmWrite(int fd, Channel* channel);
+        // 提交ASYNC_CANCEL 同步等到target请求的最后一个完成事件
+        void cancelAndWait(int fd, uint64_t target, Channel* channel);
+        // 取消过程中收到的一个完成事件 返回请求是否已经结束
+        bool drainCancelled(Channel* channel, const Completion& cqe);
+        // 把上一轮触发过的channel重新提交请求
+        void rearmFired();
+        // 收割CQ 填写活跃的连接
+        void reapCompletions(ChannelList* activeChannels);
+        void handleCqe(const Completion& cqe, ChannelList* activeChannels);
+        void handleCompletion(int fd, Channel* channel, const Completion& cqe, ChannelList* activeChannels);
+        void activate(Channel* channel, PollState& state, int revents, ChannelList* activeChannels);
+
+        const char* recvBuffer(uint16_t bid) const { return recvBuffers_ + static_cast<size_t>(bid) * kRecvBufferSize; }
+        // 把缓冲区还回环中
+        void recycleBuffer(uint16_t bid);
+
+        int ringfd_;
+
+        // SQ
+        void* sqRing_;
+        size_t sqRingSize_;
+        unsigned* sqHead_;
+        unsigned* sqTail_;
+        unsigned sqMask_;
+        unsigned sqEntries_;
+        unsigned* sqArray_;
+        io_uring_sqe* sqes_;
+        size_t sqesSize_;
+        unsigned sqLocalTail_;  // 已经填好但还没有提交给内核的SQE
+        unsigned toSubmit_;
+
+        // CQ
+        void* cqRing_;
+        size_t cqRingSize_;
+        unsigned* cqHead_;
+        unsigned* cqTail_;
+        unsigned cqMask_;
+        io_uring_cqe* cqes_;
+
+        // 提供给内核的接收缓冲区环
+        io_uring_buf* bufRing_;
+        uint16_t* bufRingTail_;   // 环的tail和第一个元素的resv字段重叠
+        uint16_t bufRingLocalTail_;
+        char* recvBuffers_;
+        bool recvCompletion_;     // 支持多次触发的recv
+        bool acceptCompletion_;   // 支持多次触发的accept
+
+        std::vector<PollState> states_;      // 以fd为下标
+        std::vector<int> fired_;             // 上一轮触发过、需要重新提交请求的fd
+        std::vector<int> pendingWrites_;     // 本轮开始关注写事件、等poll时提交WRITEV的fd
+        std::vector<Completion> deferred_;   // 同步取消时收割到的其他完成事件 下一次poll时处理
+        uint32_t round_;                     // poll的轮次
+};
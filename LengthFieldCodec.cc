@@ -0,0 +1,127 @@
+#include "LengthFieldCodec.h"
+#include "Buffer.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+#include <endian.h>
+#include <string.h>
+#include <utility>
+
+const size_t LengthFieldCodec::kDefaultMaxFrameLength;
+
+LengthFieldCodec::LengthFieldCodec(const FrameCallback& cb,
+                int lengthFieldBytes,
+                ByteOrder byteOrder,
+                size_t maxFrameLength)
+        : frameCallback_(cb)
+        , lengthFieldBytes_(lengthFieldBytes)
+        , byteOrder_(byteOrder)
+        , maxFrameLength_(maxFrameLength)
+{
+        if (lengthFieldBytes != 1 && lengthFieldBytes != 2 && lengthFieldBytes != 4 && lengthFieldBytes != 8)
+        {
+                LOG_FATAL("LengthFieldCodec lengthFieldBytes must be 1, 2, 4 or 8, got %d \n", lengthFieldBytes);
+        }
+}
+
+void LengthFieldCodec::onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp receiveTime)
+{
+        const size_t header = static_cast<size_t>(lengthFieldBytes_);
+        while (buf->readableBytes() >= header)
+        {
+                const uint64_t len = decodeLength(buf->peek());
+                if (len > maxFrameLength_)
+                {
+                        LOG_ERROR("LengthFieldCodec [%s] invalid frame length %llu \n",
+                                conn->name().c_str(), static_cast<unsigned long long>(len));
+                        buf->retrieveAll();
+                        conn->forceClose();
+                        return;
+                }
+                if (buf->readableBytes() < header + len)
+                {
+                        break; // 半帧 等后面的数据
+                }
+                frameCallback_(conn, buf->peek() + header, static_cast<size_t>(len), receiveTime);
+                buf->retrieve(header + static_cast<size_t>(len));
+        }
+}
+
+void LengthFieldCodec::send(const TcpConnectionPtr& conn, Buffer* message) const
+{
+        const size_t len = message->readableBytes();
+        // 字段宽度能表示的最大长度
+        const uint64_t limit = lengthFieldBytes_ == 8 ? UINT64_MAX : (1ULL << (lengthFieldBytes_ * 8)) - 1;
+        if (len > maxFrameLength_ || len > limit)
+        {
+                LOG_ERROR("LengthFieldCodec [%s] frame too long %zu \n", conn->name().c_str(), len);
+                return;
+        }
+        char field[8];
+        encodeLength(len, field);
+        message->prepend(field, lengthFieldBytes_);
+        conn->send(std::move(*message));
+}
+
+void LengthFieldCodec::send(const TcpConnectionPtr& conn, const char* data, size_t len) const
+{
+        Buffer message(len);
+        message.append(data, len);
+        send(conn, &message);
+}
+
+uint64_t LengthFieldCodec::decodeLength(const char* field) const
+{
+        // 长度字段不一定对齐 用memcpy读
+        switch (lengthFieldBytes_)
+        {
+        case 1:
+                return static_cast<uint8_t>(*field);
+        case 2:
+        {
+                uint16_t v;
+                ::memcpy(&v, field, sizeof v);
+                return byteOrder_ == kBigEndian ? be16toh(v) : le16toh(v);
+        }
+        case 4:
+        {
+                uint32_t v;
+                ::memcpy(&v, field, sizeof v);
+                return byteOrder_ == kBigEndian ? be32toh(v) : le32toh(v);
+        }
+        default:
+        {
+                uint64_t v;
+                ::memcpy(&v, field, sizeof v);
+                return byteOrder_ == kBigEndian ? be64toh(v) : le64toh(v);
+        }
+        }
+}
+
+void LengthFieldCodec::encodeLength(uint64_t len, char* field) const
+{
+        switch (lengthFieldBytes_)
+        {
+        case 1:
+                *field = static_cast<char>(len);
+                break;
+        case 2:
+        {
+                uint16_t v = byteOrder_ == kBigEndian ? htobe16(static_cast<uint16_t>(len)) : htole16(static_cast<uint16_t>(len));
+                ::memcpy(field, &v, sizeof v);
+                break;
+        }
+        case 4:
+        {
+                uint32_t v = byteOrder_ == kBigEndian ? htobe32(static_cast<uint32_t>(len)) : htole32(static_cast<uint32_t>(len));
+                ::memcpy(field, &v, sizeof v);
+                break;
+        }
+        default:
+        {
+                uint64_t v = byteOrder_ == kBigEndian ? htobe64(len) : htole64(len);
+                ::memcpy(field, &v, sizeof v);
+                break;
+        }
+        }
+}
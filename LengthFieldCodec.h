@@ -0,0 +1,55 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 长度头分帧的编解码器 每一帧是定长的长度字段加上消息体 长度字段只算消息体
+ * 把onMessage设置为TcpServer的MessageCallBack 每收齐一帧就调用一次FrameCallback
+ * 回调拿到的是inputBuffer中的一段 不拷贝 只在回调期间有效 一次读到多帧时逐帧回调 不分配内存
+ * 长度超过maxFrameLength的帧说明对端出错或者恶意 强制关闭连接
+*/
+class LengthFieldCodec : noncopyable
+{
+public:
+        enum ByteOrder
+        {
+                kBigEndian,    // 网络字节序
+                kLittleEndian,
+        };
+
+        // data指向inputBuffer中的消息体 回调返回后就会被retrieve
+        using FrameCallback = std::function<void(const TcpConnectionPtr&, const char* data, size_t len, Timestamp)>;
+
+        static const size_t kDefaultMaxFrameLength = 64 * 1024 * 1024;
+
+        // lengthFieldBytes只能是1、2、4、8
+        explicit LengthFieldCodec(const FrameCallback& cb,
+                int lengthFieldBytes = 4,
+                ByteOrder byteOrder = kBigEndian,
+                size_t maxFrameLength = kDefaultMaxFrameLength);
+
+        // 作为MessageCallBack使用 std::bind(&LengthFieldCodec::onMessage, &codec, _1, _2, _3)
+        void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp receiveTime);
+
+        // 加上长度头发送 message中的消息体不搬动 长度头写在kCheapPrepend预留的空间里 发送后message被清空
+        void send(const TcpConnectionPtr& conn, Buffer* message) const;
+        void send(const TcpConnectionPtr& conn, const char* data, size_t len) const;
+
+        int lengthFieldBytes() const { return lengthFieldBytes_; }
+        size_t maxFrameLength() const { return maxFrameLength_; }
+
+private:
+        uint64_t decodeLength(const char* field) const;
+        void encodeLength(uint64_t len, char* field) const;
+
+        FrameCallback frameCallback_;
+        const int lengthFieldBytes_;
+        const ByteOrder byteOrder_;
+        const size_t maxFrameLength_;
+};
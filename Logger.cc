@@ -35,6 +35,6 @@ void Logger::log(std::string msg)
                 break;
         }
 
-        // 打印时间和msg
-        std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
+        // 打印时间和msg 使用EventLoop本轮缓存的时间 不再每条日志读一次时钟
+        std::cout << Timestamp::cachedNow().toString() << " : " << msg << std::endl;
 }
\ No newline at end of file
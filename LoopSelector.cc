@@ -0,0 +1,86 @@
+#include "LoopSelector.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Timestamp.h"
+
+LoopSelector* LoopSelector::newSelector(Strategy strategy)
+{
+        switch (strategy)
+        {
+        case kLeastConnections:
+                return new LeastConnectionsSelector;
+        case kPowerOfTwoChoices:
+                return new PowerOfTwoChoicesSelector;
+        case kPeerHash:
+                return new PeerHashSelector;
+        case kRoundRobin:
+        default:
+                return new RoundRobinSelector;
+        }
+}
+
+EventLoop* RoundRobinSelector::select(const std::vector<EventLoop*>& loops, const InetAddress&)
+{
+        if (next_ >= loops.size())
+        {
+                next_ = 0;
+        }
+        return loops[next_++];
+}
+
+EventLoop* LeastConnectionsSelector::select(const std::vector<EventLoop*>& loops, const InetAddress&)
+{
+        // 连接数相同时取靠前的 loop数量通常和核数相当 线性扫描就够了
+        EventLoop* best = loops[0];
+        for (size_t i = 1; i < loops.size(); ++i)
+        {
+                if (loops[i]->numConnections() < best->numConnections())
+                {
+                        best = loops[i];
+                }
+        }
+        return best;
+}
+
+PowerOfTwoChoicesSelector::PowerOfTwoChoicesSelector()
+        : seed_(static_cast<uint64_t>(Timestamp::monotonic().microSecondsSinceEpoch()) | 1)
+{
+}
+
+uint64_t PowerOfTwoChoicesSelector::random()
+{
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 7;
+        seed_ ^= seed_ << 17;
+        return seed_;
+}
+
+uint64_t PowerOfTwoChoicesSelector::loadOf(const EventLoop* loop)
+{
+        // 忙碌程度是千分比 一个连接数相同但一直在处理事件的loop负载最多是空闲loop的两倍
+        uint64_t connections = static_cast<uint64_t>(loop->numConnections()) + 1;
+        return connections * (1000 + loop->recentLoadPermille());
+}
+
+EventLoop* PowerOfTwoChoicesSelector::select(const std::vector<EventLoop*>& loops, const InetAddress&)
+{
+        if (loops.size() == 1)
+        {
+                return loops[0];
+        }
+        size_t first = random() % loops.size();
+        size_t second = random() % (loops.size() - 1);
+        if (second >= first)
+        {
+                ++second; // 保证两个不同
+        }
+        return loadOf(loops[second]) < loadOf(loops[first]) ? loops[second] : loops[first];
+}
+
+EventLoop* PeerHashSelector::select(const std::vector<EventLoop*>& loops, const InetAddress& peerAddr)
+{
+        // 只用IP不用端口 同一个客户端的多个连接落在同一个loop上
+        uint32_t ip = peerAddr.getSockAddr()->sin_addr.s_addr;
+        uint32_t hash = ip * 2654435761u; // Knuth乘法哈希 把相邻的地址打散
+        return loops[(hash >> 16) % loops.size()];
+}
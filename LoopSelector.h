@@ -0,0 +1,65 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+class EventLoop;
+class InetAddress;
+
+// 为新连接选择subloop的策略 由EventLoopThreadPool持有 只在accept所在的线程中调用
+class LoopSelector : noncopyable
+{
+public:
+        enum Strategy
+        {
+                kRoundRobin,        // 轮询 默认
+                kLeastConnections,  // 连接数最少的loop
+                kPowerOfTwoChoices, // 随机取两个loop 选负载（连接数和最近的忙碌程度）较低的那个
+                kPeerHash,          // 按对端IP哈希 同一个客户端的连接总是落在同一个loop上
+        };
+
+        virtual ~LoopSelector() = default;
+
+        // loops非空
+        virtual EventLoop* select(const std::vector<EventLoop*>& loops, const InetAddress& peerAddr) = 0;
+
+        static LoopSelector* newSelector(Strategy strategy);
+};
+
+class RoundRobinSelector : public LoopSelector
+{
+public:
+        RoundRobinSelector() : next_(0) {}
+        EventLoop* select(const std::vector<EventLoop*>& loops, const InetAddress& peerAddr) override;
+private:
+        size_t next_;
+};
+
+class LeastConnectionsSelector : public LoopSelector
+{
+public:
+        EventLoop* select(const std::vector<EventLoop*>& loops, const InetAddress& peerAddr) override;
+};
+
+class PowerOfTwoChoicesSelector : public LoopSelector
+{
+public:
+        PowerOfTwoChoicesSelector();
+        EventLoop* select(const std::vector<EventLoop*>& loops, const InetAddress& peerAddr) override;
+
+        // loop的负载 连接数按最近的忙碌程度放大 越小越空闲
+        static uint64_t loadOf(const EventLoop* loop);
+private:
+        uint64_t random();
+
+        uint64_t seed_; // xorshift64的状态
+};
+
+class PeerHashSelector : public LoopSelector
+{
+public:
+        EventLoop* select(const std::vector<EventLoop*>& loops, const InetAddress& peerAddr) override;
+};
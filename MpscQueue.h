@@ -0,0 +1,160 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stddef.h>
+
+/*
+ * 多生产者单消费者队列 EventLoop的pendingFunctors_使用
+ * 主体是一个有界的无锁环形队列（Dmitry Vyukov的bounded queue） 生产者之间只竞争一次CAS 不需要加锁
+ * 环满了才退到一个加锁的溢出vector 保证push永远成功
+ * 同一个生产者push的元素按FIFO顺序被取出：
+ *   溢出vector非空期间所有生产者都直接写溢出vector
+ *   消费者只有在环被取空之后才把溢出vector整个换出来
+ * push可以在任意线程调用 popAll只能在消费者线程调用
+*/
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+        // capacity必须是2的幂
+        explicit MpscQueue(size_t capacity = kDefaultCapacity)
+                : cells_(capacity)
+                , mask_(capacity - 1)
+                , enqueuePos_(0)
+                , dequeuePos_(0)
+                , overflowed_(false)
+                , overflowSize_(0)
+        {
+                for (size_t i = 0; i < capacity; ++i)
+                {
+                        cells_[i].sequence.store(i, std::memory_order_relaxed);
+                }
+        }
+
+        void push(T&& value)
+        {
+                if (overflowed_.load(std::memory_order_acquire) || !tryPushRing(value))
+                {
+                        std::lock_guard<std::mutex> lock(overflowMutex_);
+                        overflow_.push_back(std::move(value));
+                        overflowSize_.store(overflow_.size(), std::memory_order_relaxed);
+                        overflowed_.store(true, std::memory_order_release);
+                }
+        }
+
+        // 把当前已经入队的元素全部移到out的末尾 返回取出的个数
+        // 只取调用时刻之前入队的元素 执行这些元素的过程中新入队的留到下一次
+        size_t popAll(std::vector<T>& out)
+        {
+                const size_t before = out.size();
+                const size_t end = enqueuePos_.load(std::memory_order_acquire);
+                size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+                bool ringEmpty = true;
+                while (pos != end)
+                {
+                        Cell& cell = cells_[pos & mask_];
+                        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+                        {
+                                // 生产者已经占了这个位置但还没写完 它写完后会自己唤醒loop
+                                ringEmpty = false;
+                                break;
+                        }
+                        out.push_back(std::move(cell.value));
+                        cell.value = T();
+                        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                        ++pos;
+                }
+                dequeuePos_.store(pos, std::memory_order_relaxed);
+
+                if (ringEmpty && overflowed_.load(std::memory_order_acquire))
+                {
+                        std::lock_guard<std::mutex> lock(overflowMutex_);
+                        // 快照之后又有元素进了环 它们可能早于同一生产者溢出的元素 这一轮先不取溢出vector
+                        if (pos != enqueuePos_.load(std::memory_order_acquire))
+                        {
+                                return out.size() - before;
+                        }
+                        for (T& value : overflow_)
+                        {
+                                out.push_back(std::move(value));
+                        }
+                        overflow_.clear();
+                        overflowSize_.store(0, std::memory_order_relaxed);
+                        overflowed_.store(false, std::memory_order_release);
+                }
+                return out.size() - before;
+        }
+
+        // 只在消费者线程调用时准确
+        bool empty() const
+        {
+                return dequeuePos_.load(std::memory_order_relaxed) == enqueuePos_.load(std::memory_order_acquire)
+                        && !overflowed_.load(std::memory_order_acquire);
+        }
+
+        // 队列中元素的个数 可以在任意线程调用 只是一个近似值 用于统计
+        size_t size() const
+        {
+                size_t dequeued = dequeuePos_.load(std::memory_order_relaxed);
+                size_t enqueued = enqueuePos_.load(std::memory_order_relaxed);
+                size_t inRing = enqueued > dequeued ? enqueued - dequeued : 0;
+                return inRing + overflowSize_.load(std::memory_order_relaxed);
+        }
+
+        static const size_t kDefaultCapacity = 1024;
+private:
+        struct Cell
+        {
+                std::atomic<size_t> sequence; // 等于位置时可写 等于位置+1时可读
+                T value;
+        };
+
+        bool tryPushRing(T& value)
+        {
+                size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                        Cell& cell = cells_[pos & mask_];
+                        size_t seq = cell.sequence.load(std::memory_order_acquire);
+                        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                        if (diff == 0)
+                        {
+                                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                                {
+                                        cell.value = std::move(value);
+                                        cell.sequence.store(pos + 1, std::memory_order_release);
+                                        return true;
+                                }
+                        }
+                        else if (diff < 0)
+                        {
+                                return false; // 环满了
+                        }
+                        else
+                        {
+                                pos = enqueuePos_.load(std::memory_order_relaxed);
+                        }
+                }
+        }
+
+        std::vector<Cell> cells_;
+        const size_t mask_;
+
+        // 生产者和消费者各自的位置放在不同的cache line上
+        // 用填充而不是alignas 因为C++11的new不保证超过16字节的对齐
+        static const size_t kCacheLineSize = 64;
+        char pad0_[kCacheLineSize];
+        std::atomic<size_t> enqueuePos_;
+        char pad1_[kCacheLineSize - sizeof(size_t)];
+        std::atomic<size_t> dequeuePos_; // 只有消费者写 原子只是为了让size()可以在其他线程读
+        char pad2_[kCacheLineSize - sizeof(size_t)];
+
+        std::atomic_bool overflowed_;
+        std::atomic<size_t> overflowSize_;
+        std::mutex overflowMutex_;
+        std::vector<T> overflow_;
+};
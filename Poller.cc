@@ -3,12 +3,40 @@
 
 
 Poller::Poller(EventLoop* loop)
-        : ownerLoop_(loop)
+        : numChannels_(0)
+        , interestUpdates_(0)
+        , interestKernelOps_(0)
+        , ownerLoop_(loop)
 {
 }
 
 bool Poller::hasChannel(Channel* channel) const
 {
-        auto it = channels_.find(channel->fd());
-        return it != channels_.end() && it->second == channel; 
+        return findChannel(channel->fd()) == channel;
+}
+
+void Poller::insertChannel(Channel* channel)
+{
+        size_t fd = static_cast<size_t>(channel->fd());
+        if (fd >= channels_.size())
+        {
+                ChannelSlot empty = { nullptr, 0 };
+                channels_.resize(fd + 1, empty);
+        }
+        ChannelSlot& slot = channels_[fd];
+        if (slot.channel == nullptr)
+        {
+                ++numChannels_;
+        }
+        slot.channel = channel;
+        ++slot.generation;
+}
+
+void Poller::eraseChannel(int fd)
+{
+        if (static_cast<size_t>(fd) < channels_.size() && channels_[fd].channel != nullptr)
+        {
+                channels_[fd].channel = nullptr;
+                --numChannels_;
+        }
 }
@@ -4,7 +4,7 @@
 #include "Timestamp.h"
 
 #include <vector>
-#include <unordered_map>
+#include <stdint.h>
 
 class Channel;
 class EventLoop;
@@ -26,13 +26,40 @@ public:
         // 判断参数channel是否在当前Poller中
         bool hasChannel(Channel* channel) const;
 
+        // 关注事件的更新统计 只在loop线程中读取
+        // updates是Channel发起的注册/修改/删除次数 kernelOps是真正交给内核的次数（epoll_ctl或io_uring的SQE）
+        // 两者之差就是被合并或者省掉的更新
+        uint64_t interestUpdates() const { return interestUpdates_; }
+        uint64_t interestKernelOps() const { return interestKernelOps_; }
+
         // EventLoop 可以通过该接口获取默认的IO复用的具体实现
         static Poller* newDefaultPoller(EventLoop* Loop);
 protected:
-        // map-key: sockfd
-        // map-value: sockfd所属的channel通道类型
-        using ChannelMap = std::unordered_map<int, Channel*>;   //无需排序 速度更快
-        ChannelMap channels_;   
+        // 以fd为下标的channel表 fd是小而稠密的整数 直接下标访问 不需要哈希 注册时也不需要为每个channel分配节点
+        // generation在fd每次重新注册时递增 用来识别已经失效的旧事件
+        void insertChannel(Channel* channel);
+        void eraseChannel(int fd);
+        Channel* findChannel(int fd) const
+        {
+                return static_cast<size_t>(fd) < channels_.size() ? channels_[fd].channel : nullptr;
+        }
+        uint32_t generationOf(int fd) const { return channels_[fd].generation; }
+        size_t numChannels() const { return numChannels_; }
+
+        void countInterestUpdate() { ++interestUpdates_; }
+        void countInterestKernelOps(uint64_t n) { interestKernelOps_ += n; }
 private:
+        struct ChannelSlot
+        {
+                Channel* channel;
+                uint32_t generation;
+        };
+        using ChannelTable = std::vector<ChannelSlot>;
+        ChannelTable channels_;
+        size_t numChannels_;
+
+        uint64_t interestUpdates_;
+        uint64_t interestKernelOps_;
+
         EventLoop* ownerLoop_; // 定义Poller所属的事件循环
 };
\ No newline at end of file
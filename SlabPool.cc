@@ -0,0 +1,220 @@
+#include "SlabPool.h"
+#include "CurrentThread.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+static_assert(SlabPool::kArenaSize % SlabPool::kSlabSize == 0, "arena must hold whole slabs");
+static_assert(SlabPool::kHeaderSize >= sizeof(SlabPool*), "header must hold the owner pool");
+
+SlabPool::SlabPool()
+        : ownerTid_(CurrentThread::tid())
+        , freeList_(nullptr)
+        , remoteList_(nullptr)
+        , refs_(1)
+        , ownerGone_(false)
+        , hugePages_(false)
+        , inUse_(0)
+        , free_(0)
+        , highWater_(0)
+        , numArenas_(0)
+        , remoteFrees_(0)
+        , fallbacks_(0)
+{
+}
+
+SlabPool::~SlabPool()
+{
+        for (void* arena : arenas_)
+        {
+                ::munmap(arena, kArenaSize);
+        }
+}
+
+void SlabPool::release()
+{
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+                delete this;
+        }
+}
+
+bool SlabPool::isOwnerThread() const
+{
+        return ownerTid_ == CurrentThread::tid() && !ownerGone_.load(std::memory_order_acquire);
+}
+
+SlabPool::Stats SlabPool::stats() const
+{
+        Stats s;
+        s.inUse = inUse_.load(std::memory_order_relaxed);
+        s.free = free_.load(std::memory_order_relaxed);
+        s.highWater = highWater_.load(std::memory_order_relaxed);
+        s.arenas = numArenas_.load(std::memory_order_relaxed);
+        s.remoteFrees = remoteFrees_.load(std::memory_order_relaxed);
+        s.fallbacks = fallbacks_.load(std::memory_order_relaxed);
+        s.hugePages = hugePages_.load(std::memory_order_relaxed);
+        return s;
+}
+
+void* SlabPool::allocate(SlabPool* pool, size_t n)
+{
+        void* block = nullptr;
+        if (pool != nullptr && n >= kMinBytes && n <= kMaxBytes && pool->isOwnerThread())
+        {
+                block = pool->takeSlab();
+        }
+        SlabPool* owner = block != nullptr ? pool : nullptr;
+        if (block == nullptr)
+        {
+                if (pool != nullptr && n > kMaxBytes)
+                {
+                        pool->fallbacks_.fetch_add(1, std::memory_order_relaxed);
+                }
+                block = ::malloc(kHeaderSize + n);
+                if (block == nullptr)
+                {
+                        throw std::bad_alloc();
+                }
+        }
+        *static_cast<SlabPool**>(block) = owner;
+        return static_cast<char*>(block) + kHeaderSize;
+}
+
+void SlabPool::deallocate(void* p)
+{
+        if (p == nullptr)
+        {
+                return;
+        }
+        void* block = static_cast<char*>(p) - kHeaderSize;
+        SlabPool* owner = *static_cast<SlabPool**>(block);
+        if (owner == nullptr)
+        {
+                ::free(block);
+        }
+        else if (owner->isOwnerThread())
+        {
+                owner->giveSlab(block);
+        }
+        else
+        {
+                owner->giveRemote(block);
+        }
+}
+
+// 单写者的统计 只有所属线程调用
+static void add(std::atomic<size_t>& counter, size_t n)
+{
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static void sub(std::atomic<size_t>& counter, size_t n)
+{
+        counter.store(counter.load(std::memory_order_relaxed) - n, std::memory_order_relaxed);
+}
+
+void* SlabPool::takeSlab()
+{
+        if (freeList_ == nullptr)
+        {
+                drainRemote();
+        }
+        if (freeList_ == nullptr && !newArena())
+        {
+                return nullptr;
+        }
+        FreeSlab* slab = freeList_;
+        freeList_ = slab->next;
+        sub(free_, 1);
+        add(inUse_, 1);
+        size_t inUse = inUse_.load(std::memory_order_relaxed);
+        if (inUse > highWater_.load(std::memory_order_relaxed))
+        {
+                highWater_.store(inUse, std::memory_order_relaxed);
+        }
+        retain();
+        return slab;
+}
+
+void SlabPool::giveSlab(void* block)
+{
+        FreeSlab* slab = static_cast<FreeSlab*>(block);
+        slab->next = freeList_;
+        freeList_ = slab;
+        sub(inUse_, 1);
+        add(free_, 1);
+        release();
+}
+
+void SlabPool::giveRemote(void* block)
+{
+        FreeSlab* slab = static_cast<FreeSlab*>(block);
+        slab->next = remoteList_.load(std::memory_order_relaxed);
+        while (!remoteList_.compare_exchange_weak(slab->next, slab, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        remoteFrees_.fetch_add(1, std::memory_order_relaxed);
+        release();
+}
+
+// 取回其他线程释放的slab 整条链表一次换出来 只有一个消费者 没有ABA问题
+void SlabPool::drainRemote()
+{
+        FreeSlab* slab = remoteList_.exchange(nullptr, std::memory_order_acquire);
+        size_t n = 0;
+        while (slab != nullptr)
+        {
+                FreeSlab* next = slab->next;
+                slab->next = freeList_;
+                freeList_ = slab;
+                slab = next;
+                ++n;
+        }
+        sub(inUse_, n);
+        add(free_, n);
+}
+
+bool SlabPool::newArena()
+{
+        // 多申请一个arena的大小 从中截出按kArenaSize对齐的一段 大页要求2M对齐
+        size_t length = kArenaSize * 2;
+        void* raw = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+        {
+                LOG_ERROR("SlabPool::newArena mmap error:%d \n", errno);
+                return false;
+        }
+        uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = (begin + kArenaSize - 1) & ~(static_cast<uintptr_t>(kArenaSize) - 1);
+        if (aligned > begin)
+        {
+                ::munmap(raw, aligned - begin);
+        }
+        if (aligned + kArenaSize < begin + length)
+        {
+                ::munmap(reinterpret_cast<void*>(aligned + kArenaSize), begin + length - aligned - kArenaSize);
+        }
+        char* arena = reinterpret_cast<char*>(aligned);
+
+        if (hugePages_.load(std::memory_order_relaxed) && ::madvise(arena, kArenaSize, MADV_HUGEPAGE) < 0)
+        {
+                // 内核没有开启透明大页时失败 不影响使用
+                LOG_INFO("SlabPool::newArena madvise(MADV_HUGEPAGE) error:%d \n", errno);
+        }
+
+        arenas_.push_back(arena);
+        add(numArenas_, 1);
+        for (size_t offset = kArenaSize; offset >= kSlabSize; offset -= kSlabSize)
+        {
+                FreeSlab* slab = reinterpret_cast<FreeSlab*>(arena + offset - kSlabSize);
+                slab->next = freeList_;
+                freeList_ = slab;
+        }
+        add(free_, kArenaSize / kSlabSize);
+        return true;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * 每个EventLoop一个的slab内存池 连接的输入输出缓冲区从这里取内存 析构时还回来
+ * 内存按kArenaSize从mmap整块申请 切成kSlabSize的slab挂在空闲链表上 反复建连断连时只在链表上进出
+ * 不会在全局堆上留下大大小小的碎片 可以选择对arena开启MADV_HUGEPAGE减少TLB miss
+ * 分配只在所属线程进行 不加锁 其他线程释放的slab（连接迁移到别的loop或者在别的线程析构）
+ * 先压到一个无锁的远端链表上 所属线程下次分配时整个取回
+ * 池子在所属loop析构后仍然存活 直到使用它的缓冲区都析构、借出去的slab都还回来
+*/
+class SlabPool : noncopyable
+{
+public:
+        static const size_t kSlabSize = 16 * 1024;         // 每个slab的大小 包括头部
+        static const size_t kArenaSize = 2 * 1024 * 1024;  // 每次向系统申请的大小 等于一个大页
+        static const size_t kHeaderSize = 16;              // 每块内存前面记录来源的头部
+        static const size_t kMaxBytes = kSlabSize - kHeaderSize; // 能从池中分配的最大字节数
+        static const size_t kMinBytes = 2 * 1024;          // 小于它的申请用malloc 不为1KB的缓冲区占掉一整个slab
+
+        struct Stats
+        {
+                size_t inUse;          // 借出去还没还的slab数 其他线程释放还没取回的也算在内
+                size_t free;           // 空闲链表上的slab数
+                size_t highWater;      // inUse的历史最大值
+                size_t arenas;         // 已经申请的arena数
+                uint64_t remoteFrees;  // 其他线程释放的slab数
+                uint64_t fallbacks;    // 超过kMaxBytes而改用malloc的次数 小于kMinBytes的不算
+                bool hugePages;
+        };
+
+        // 所属线程是构造它的线程 构造者持有一个引用
+        SlabPool();
+
+        // 引用计数 使用pool的缓冲区各持有一个引用 每个借出去的slab也持有一个
+        // 不用delete 最后一个引用释放时池子自己销毁
+        void retain() { refs_.fetch_add(1, std::memory_order_relaxed); }
+        void release();
+
+        // 所属loop析构时调用 之后所有线程都不再从池中分配 释放的slab都走远端链表
+        void detachOwner() { ownerGone_.store(true, std::memory_order_release); }
+
+        // 之后新申请的arena是否开启MADV_HUGEPAGE 可以在任意线程设置
+        void setHugePages(bool on) { hugePages_.store(on, std::memory_order_relaxed); }
+
+        // 可以在任意线程调用 读到的是近似值
+        Stats stats() const;
+
+        // 分配n字节 pool不为空、n在[kMinBytes, kMaxBytes]之间并且在pool的所属线程中时取一个slab 否则用malloc
+        static void* allocate(SlabPool* pool, size_t n);
+        // 释放allocate返回的内存 根据头部记录的来源归还 可以在任意线程调用
+        static void deallocate(void* p);
+
+private:
+        // 空闲的slab复用自己的内存作为链表节点
+        struct FreeSlab
+        {
+                FreeSlab* next;
+        };
+
+        ~SlabPool();
+
+        void* takeSlab();
+        void giveSlab(void* slab);
+        void giveRemote(void* slab);
+        void drainRemote();
+        bool newArena();
+        bool isOwnerThread() const;
+
+        const pid_t ownerTid_;
+        FreeSlab* freeList_;                     // 只有所属线程访问
+        std::atomic<FreeSlab*> remoteList_;      // 其他线程释放的slab
+        std::atomic<long> refs_;
+        std::atomic_bool ownerGone_;
+        std::atomic_bool hugePages_;
+        std::vector<void*> arenas_;
+
+        // 单写者的统计 其他线程只读
+        std::atomic<size_t> inUse_;
+        std::atomic<size_t> free_;
+        std::atomic<size_t> highWater_;
+        std::atomic<size_t> numArenas_;
+        std::atomic<uint64_t> remoteFrees_;
+        std::atomic<uint64_t> fallbacks_;
+};
+
+/*
+ * 从SlabPool分配内存的STL分配器 Buffer的vector使用
+ * 不小于kMinBytes、不超过一个slab的申请从pool中分配 其余的或者pool不在当前线程时用malloc
+ * 释放只看内存头部记录的来源 所以任意两个分配器都相等
+*/
+template <typename T>
+class SlabAllocator
+{
+public:
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::true_type;
+
+        // 每个分配器持有pool的一个引用 保证容器还在时pool不会销毁
+        explicit SlabAllocator(SlabPool* pool = nullptr) : pool_(pool) { retain(); }
+        SlabAllocator(const SlabAllocator& other) : pool_(other.pool_) { retain(); }
+        template <typename U>
+        SlabAllocator(const SlabAllocator<U>& other) : pool_(other.pool()) { retain(); }
+        SlabAllocator& operator=(const SlabAllocator& other)
+        {
+                if (pool_ != other.pool_)
+                {
+                        SlabPool* old = pool_;
+                        pool_ = other.pool_;
+                        retain();
+                        if (old != nullptr)
+                        {
+                                old->release();
+                        }
+                }
+                return *this;
+        }
+        ~SlabAllocator()
+        {
+                if (pool_ != nullptr)
+                {
+                        pool_->release();
+                }
+        }
+
+        T* allocate(size_t n) { return static_cast<T*>(SlabPool::allocate(pool_, n * sizeof(T))); }
+        void deallocate(T* p, size_t) { SlabPool::deallocate(p); }
+
+        SlabPool* pool() const { return pool_; }
+
+        template <typename U>
+        bool operator==(const SlabAllocator<U>&) const { return true; }
+        template <typename U>
+        bool operator!=(const SlabAllocator<U>&) const { return false; }
+
+private:
+        void retain()
+        {
+                if (pool_ != nullptr)
+                {
+                        pool_->retain();
+                }
+        }
+
+        SlabPool* pool_;
+};
@@ -7,6 +7,18 @@
 #include <sys/socket.h>
 #include <strings.h>
 #include <netinet/tcp.h>
+#include <errno.h>
+
+// 旧版本的头文件中没有这两个选项
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
 
 Socket::~Socket()
 {
@@ -78,4 +90,30 @@ void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
-}
\ No newline at end of file
+}
+
+bool Socket::setBusyPoll(int usec)
+{
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof usec) < 0)
+    {
+        LOG_DEBUG("setsockopt SO_BUSY_POLL fd:%d err:%d \n", sockfd_, errno);
+        return false;
+    }
+    int prefer = 1;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof prefer) < 0)
+    {
+        LOG_DEBUG("setsockopt SO_PREFER_BUSY_POLL fd:%d err:%d \n", sockfd_, errno);
+    }
+    return true;
+}
+
+bool Socket::setZeroCopy(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof optval) < 0)
+    {
+        LOG_DEBUG("setsockopt SO_ZEROCOPY fd:%d err:%d \n", sockfd_, errno);
+        return false;
+    }
+    return true;
+}
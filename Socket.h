@@ -39,6 +39,13 @@ public:
 
         // 设置TCP连接选项
         void setKeepAlive(bool on);
+
+        // 设置SO_BUSY_POLL和SO_PREFER_BUSY_POLL 内核在阻塞读之前先忙轮询网卡队列usec微秒
+        // 内核不支持或者权限不足时返回false
+        bool setBusyPoll(int usec);
+
+        // 设置SO_ZEROCOPY 之后才能用MSG_ZEROCOPY发送 内核不支持时返回false
+        bool setZeroCopy(bool on);
         
 private:
         const int sockfd_;
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <functional>
+#include <new>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+
+/*
+ * 只能移动的无参可调用对象 EventLoop::Functor使用
+ * 不超过kInlineSize字节的闭包直接放在对象内部 不需要分配内存 更大的才放到堆上
+ * 库里自己投递的std::bind(&TcpConnection::xxx, shared_from_this(), ...)都在这个范围内
+ * 和std::function不同 它不能拷贝 一个任务从runInLoop/queueInLoop到被执行只会被移动
+ * 由空的std::function或者空函数指针构造的Task也是空的 和std::function一样调用空Task抛出std::bad_function_call
+*/
+class Task
+{
+public:
+        static const size_t kInlineSize = 64;
+
+        Task() : ops_(nullptr) {}
+
+        template <typename F,
+                typename = typename std::enable_if<
+                        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+        Task(F&& f) : ops_(nullptr)
+        {
+                using Fn = typename std::decay<F>::type;
+                if (isNull(f))
+                {
+                        return;
+                }
+                construct<Fn>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Fn>()>());
+        }
+
+        Task(Task&& other) noexcept : ops_(other.ops_)
+        {
+                if (ops_ != nullptr)
+                {
+                        ops_->move(&other.storage_, &storage_);
+                        other.ops_ = nullptr;
+                }
+        }
+
+        Task& operator=(Task&& other) noexcept
+        {
+                if (this != &other)
+                {
+                        reset();
+                        ops_ = other.ops_;
+                        if (ops_ != nullptr)
+                        {
+                                ops_->move(&other.storage_, &storage_);
+                                other.ops_ = nullptr;
+                        }
+                }
+                return *this;
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        ~Task() { reset(); }
+
+        void operator()()
+        {
+                if (ops_ == nullptr)
+                {
+                        throw std::bad_function_call();
+                }
+                ops_->invoke(&storage_);
+        }
+
+        explicit operator bool() const { return ops_ != nullptr; }
+
+        // 闭包是否会放在对象内部
+        template <typename Fn>
+        static constexpr bool fitsInline()
+        {
+                return sizeof(Fn) <= kInlineSize
+                        && alignof(Fn) <= alignof(Storage)
+                        && std::is_nothrow_move_constructible<Fn>::value;
+        }
+
+private:
+        using Storage = typename std::aligned_storage<kInlineSize, alignof(max_align_t)>::type;
+
+        struct Ops
+        {
+                void (*invoke)(void* storage);
+                void (*move)(void* from, void* to); // 移动到to 并析构from
+                void (*destroy)(void* storage);
+        };
+
+        // 空的可调用对象不保存 构造出空Task
+        template <typename Fn>
+        static bool isNull(const Fn&) { return false; }
+        template <typename R, typename... Args>
+        static bool isNull(const std::function<R(Args...)>& f) { return !f; }
+        template <typename R, typename... Args>
+        static bool isNull(R (*f)(Args...)) { return f == nullptr; }
+
+        // 闭包直接构造在storage_中
+        template <typename Fn>
+        struct InlineOps
+        {
+                static Fn* get(void* storage) { return static_cast<Fn*>(storage); }
+                static void invoke(void* storage) { (*get(storage))(); }
+                static void move(void* from, void* to)
+                {
+                        ::new (to) Fn(std::move(*get(from)));
+                        get(from)->~Fn();
+                }
+                static void destroy(void* storage) { get(storage)->~Fn(); }
+                static constexpr Ops ops = { &invoke, &move, &destroy };
+        };
+
+        // storage_中只保存指向堆上闭包的指针
+        template <typename Fn>
+        struct HeapOps
+        {
+                static Fn*& get(void* storage) { return *static_cast<Fn**>(storage); }
+                static void invoke(void* storage) { (*get(storage))(); }
+                static void move(void* from, void* to) { ::new (to) Fn*(get(from)); }
+                static void destroy(void* storage) { delete get(storage); }
+                static constexpr Ops ops = { &invoke, &move, &destroy };
+        };
+
+        template <typename Fn, typename F>
+        void construct(F&& f, std::true_type)
+        {
+                ::new (&storage_) Fn(std::forward<F>(f));
+                ops_ = &InlineOps<Fn>::ops;
+        }
+
+        template <typename Fn, typename F>
+        void construct(F&& f, std::false_type)
+        {
+                ::new (&storage_) Fn*(new Fn(std::forward<F>(f)));
+                ops_ = &HeapOps<Fn>::ops;
+        }
+
+        void reset()
+        {
+                if (ops_ != nullptr)
+                {
+                        ops_->destroy(&storage_);
+                        ops_ = nullptr;
+                }
+        }
+
+        const Ops* ops_;
+        Storage storage_;
+};
+
+template <typename Fn>
+constexpr Task::Ops Task::InlineOps<Fn>::ops;
+
+template <typename Fn>
+constexpr Task::Ops Task::HeapOps<Fn>::ops;
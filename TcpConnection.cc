@@ -3,14 +3,25 @@
 #include "Channel.h"
 #include "EventLoop.h"
 #include "Socket.h"
+#include "SlabPool.h"
 
 #include <functional>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <netinet/tcp.h>
+#include <netinet/in.h>
+#include <string.h>
 #include <string>
+#include <thread>
+
+// ET模式下每个事件最多读/写的次数
+static const int kMaxIoPerEvent = 16;
+// ET模式下每个事件最多读进inputBuffer_的字节数 一次读太多会把inputBuffer_撑大到cache放不下
+static const ssize_t kMaxReadBytesPerEvent = 64 * 1024;
 
 static EventLoop* CheckLoopNotNull(EventLoop* loop)
 {
@@ -30,12 +41,31 @@ TcpConnection::TcpConnection(EventLoop* loop,
                 , name_(nameArg)
                 , state_(kConnecting)
                 , reading_(true)
+                , counted_(true)
                 , socket_(new Socket(sockfd))
                 , channel_(new Channel(loop, sockfd))
                 , localAddr_(localAddr)
                 , peerAddr_(peerAddr)
                 , highWaterMark_(64*1024*1024) // 64M
+                , zeroCopyThreshold_(0)
+                , zeroCopy_(false)
+                , corked_(false)
+                , flushQueued_(false)
+                , inputBuffer_(loop->slabPool(), Buffer::kInitialSize) // 初始的1KB不从pool中分配 长大时已经在所属loop上
+                , received_(false)
+                , receivedBytes_(0)
+                , receivedEnd_(1)
+                , outputBuffer_(loop->slabPool())
+                , sent_(false)
+                , sentResult_(0)
+                , idleTimeout_(0.0)
+                , idleEntry_(std::bind(&TcpConnection::handleIdleTimeout, this))
+                , readWaiter_(nullptr)
+                , writeWaiter_(nullptr)
+                , migrating_(false)
+                , posting_(0)
 {
+        loop->adjustConnections(1); // 选择subloop时的负载信息 从分配loop起就计入 一批连接接连到达时能看到前面的选择
         // 给channel设置回调函数，poller给channel通知感兴趣的事件发生了，channel就会回调相应的操作函数
         channel_->setReadCallback(
                 std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
@@ -49,6 +79,13 @@ TcpConnection::TcpConnection(EventLoop* loop,
         channel_->setErrorCallback(
                 std::bind(&TcpConnection::handleError, this)
         );
+        channel_->setCompletionCallback(Channel::kRecvCompletion,
+                std::bind(&TcpConnection::handleRecvCompletion, this, std::placeholders::_1, std::placeholders::_2)
+        );
+        channel_->setWriteCompletionCallback(
+                std::bind(&TcpConnection::gatherOutput, this, std::placeholders::_1, std::placeholders::_2),
+                std::bind(&TcpConnection::handleWriteCompletion, this, std::placeholders::_1)
+        );
 
         LOG_INFO("TcpConnection::ctor[%s] at %p fd=%d\n", name_.c_str(), this, sockfd);
         socket_->setKeepAlive(true);
@@ -59,6 +96,10 @@ TcpConnection::~TcpConnection()
 {
         LOG_INFO("TcpConnection::dtor[%s] at %p fd=%d state=%d\n",
                 name_.c_str(), this, channel_->fd(), (int)state_);
+        if (counted_)
+        {
+                getLoop()->adjustConnections(-1); // 没有经过connectDestroyed 比如从没交给TcpServer
+        }
 }
 
 // 发送数据
@@ -66,22 +107,103 @@ void TcpConnection::send(const std::string &buf)
 {
         if (state_ == kConnected)
         {
-                if (loop_->isInLoopThread())
+                if (isInLoopThread())
                 {
                         sendInLoop(buf.c_str(), buf.size());
                 }
                 else
                 {
-                        loop_->runInLoop(std::bind(
-                                &TcpConnection::sendInLoop,
-                                this,
-                                buf.c_str(),
-                                buf.size()
+                        // 任务执行时调用者的buf可能已经不在了 带着一份拷贝投递
+                        send(std::string(buf));
+                }
+        }
+}
+
+void TcpConnection::send(std::string&& buf)
+{
+        if (state_ == kConnected)
+        {
+                if (isInLoopThread())
+                {
+                        sendStringInLoop(buf);
+                }
+                else
+                {
+                        queueInLoop(std::bind(
+                                &TcpConnection::sendStringInLoop,
+                                std::placeholders::_1,
+                                std::move(buf)
                         ));
                 }
         }
 }
 
+void TcpConnection::send(Buffer&& buf)
+{
+        if (state_ == kConnected)
+        {
+                if (isInLoopThread())
+                {
+                        sendBufferInLoop(buf);
+                }
+                else
+                {
+                        queueInLoop(std::bind(
+                                &TcpConnection::sendBufferInLoop,
+                                std::placeholders::_1,
+                                std::move(buf)
+                        ));
+                }
+        }
+}
+
+void TcpConnection::send(std::vector<std::string>&& slices)
+{
+        if (state_ == kConnected)
+        {
+                if (isInLoopThread())
+                {
+                        sendSlicesInLoop(slices);
+                }
+                else
+                {
+                        queueInLoop(std::bind(
+                                &TcpConnection::sendSlicesInLoop,
+                                std::placeholders::_1,
+                                std::move(slices)
+                        ));
+                }
+        }
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t length)
+{
+        if (state_ != kConnected || length == 0)
+        {
+                return;
+        }
+        int dupFd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dupFd < 0)
+        {
+                LOG_ERROR("TcpConnection::sendFile dup fd=%d error:%d \n", fd, errno);
+                return;
+        }
+        if (isInLoopThread())
+        {
+                sendFileInLoop(dupFd, offset, length);
+        }
+        else
+        {
+                queueInLoop(std::bind(
+                        &TcpConnection::sendFileInLoop,
+                        std::placeholders::_1,
+                        dupFd,
+                        offset,
+                        length
+                ));
+        }
+}
+
 /*
  * 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区 而且设置了水位回调
 */
@@ -98,8 +220,9 @@ void TcpConnection::sendInLoop(const void* message, size_t len)
                 return;
         }
 
-        // 表示channel_第一次开始写数据 而且outputBuffer_中没有数据
-        if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+        // 表示channel_第一次开始写数据 而且outputBuffer_中没有数据 corked时只追加 留到本轮结束一起写
+        // poller替连接写时也只追加 在poll时和其他连接的写一起提交
+        if (!corked_ && !channel_->isWriting() && outputBuffer_.readableBytes() == 0 && !writesByCompletion())
         {
                 nwrote = ::write(channel_->fd(), message, len);
                 if (nwrote >= 0)
@@ -108,7 +231,7 @@ void TcpConnection::sendInLoop(const void* message, size_t len)
                         remaining = len - nwrote;
                         if (remaining == 0 && writeCompleteCallback_)
                         {
-                                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                                queueInLoop(std::bind(&TcpConnection::notifyWriteComplete, std::placeholders::_1));
                         }
                 }
                 else
@@ -116,7 +239,7 @@ void TcpConnection::sendInLoop(const void* message, size_t len)
                         nwrote = 0;
                         if (errno != EWOULDBLOCK)
                         {
-                                LOG_ERROR("TcpConnection::sendInLoop");
+                                LOG_ERROR("TcpConnection::sendInLoop \n");
                                 if (errno == EPIPE || errno == ECONNRESET)
                                 {
                                         faultError = true;
@@ -135,46 +258,414 @@ void TcpConnection::sendInLoop(const void* message, size_t len)
                         && oldLen < highWaterMark_
                         && highWaterMarkCallback_)
                 {
-                        loop_->queueInLoop(std::bind(
-                                highWaterMarkCallback_, shared_from_this(), oldLen + remaining
+                        queueInLoop(std::bind(
+                                &TcpConnection::notifyHighWaterMark, std::placeholders::_1, oldLen + remaining
                         ));
                 }
                 outputBuffer_.append(static_cast<const char*>(message) + nwrote, remaining);
-                if (!channel_->isWriting())
+                if (corked_)
+                {
+                        scheduleFlush();
+                }
+                else if (!channel_->isWriting())
                 {
                         channel_->enableWriting();  // 注册channel的写事件 否则poller不会给channel通知epollout
                 }
         }
 }
 
+// 接管buf的内存挂到outputBuffer_上 不拷贝
+void TcpConnection::sendStringInLoop(std::string& buf)
+{
+        if (state_ == kDisconnected)
+        {
+                LOG_ERROR("disconnected, give up writing \n");
+                return;
+        }
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.append(std::move(buf));
+        flushAppended(oldLen);
+}
+
+void TcpConnection::sendBufferInLoop(Buffer& buf)
+{
+        if (state_ == kDisconnected)
+        {
+                LOG_ERROR("disconnected, give up writing \n");
+                return;
+        }
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.append(std::move(buf));
+        flushAppended(oldLen);
+}
+
+void TcpConnection::sendSlicesInLoop(std::vector<std::string>& slices)
+{
+        if (state_ == kDisconnected)
+        {
+                LOG_ERROR("disconnected, give up writing \n");
+                return;
+        }
+        size_t oldLen = outputBuffer_.readableBytes();
+        for (std::string& slice : slices)
+        {
+                outputBuffer_.append(std::move(slice));
+        }
+        flushAppended(oldLen);
+}
+
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length)
+{
+        if (state_ == kDisconnected)
+        {
+                LOG_ERROR("disconnected, give up sending file \n");
+                ::close(fd);
+                return;
+        }
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.appendFile(fd, offset, length);
+        flushAppended(oldLen);
+}
+
+/*
+ * 接管的数据先挂到outputBuffer_上 再和sendInLoop一样 没有在等可写时立即写一次
+ * 用writev把新挂上的各段一次写出 写不完的留在链上注册EPOLLOUT 不需要再拷贝一次
+*/
+void TcpConnection::flushAppended(size_t oldLen)
+{
+        if (outputBuffer_.readableBytes() == oldLen)
+        {
+                return;
+        }
+
+        if (!corked_ && !channel_->isWriting() && oldLen == 0 && !writeNow())
+        {
+                return;
+        }
+
+        size_t newLen = outputBuffer_.readableBytes();
+        if (newLen >= highWaterMark_
+                && oldLen < highWaterMark_
+                && highWaterMarkCallback_)
+        {
+                queueInLoop(std::bind(
+                        &TcpConnection::notifyHighWaterMark, std::placeholders::_1, newLen
+                ));
+        }
+        if (corked_)
+        {
+                scheduleFlush();
+        }
+        else if (!channel_->isWriting())
+        {
+                channel_->enableWriting();
+        }
+}
+
+bool TcpConnection::writeNow()
+{
+        if (writesByCompletion())
+        {
+                return outputBuffer_.readableBytes() > 0; // enableWriting之后由poller提交
+        }
+        int savedErrno = 0;
+        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno, zeroCopyThreshold_);
+        if (n >= 0)
+        {
+                outputBuffer_.retrieve(n);
+                if (outputBuffer_.readableBytes() == 0)
+                {
+                        outputDrained();
+                        return false;
+                }
+        }
+        else if (savedErrno != EWOULDBLOCK)
+        {
+                LOG_ERROR("TcpConnection::writeNow \n");
+                if (savedErrno == EIO)
+                {
+                        forceCloseInLoop();
+                        return false;
+                }
+                if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+                {
+                        // 和sendInLoop一样放弃还没发出的数据
+                        outputBuffer_.retrieveAll();
+                        return false;
+                }
+        }
+        return true;
+}
+
+void TcpConnection::outputDrained()
+{
+        if (writeWaiter_ != nullptr)
+        {
+                // 不在handleWrite中间恢复协程 它可能马上又要写
+                queueInLoop(std::bind(&TcpConnection::resumeWriteWaiter, std::placeholders::_1));
+        }
+        if (writeCompleteCallback_)
+        {
+                // 唤醒loop_ 对应的thread，执行回调函数
+                queueInLoop(std::bind(&TcpConnection::notifyWriteComplete, std::placeholders::_1));
+        }
+        if (state_ == kDisconnecting)
+        {
+                shutdownInLoop();
+        }
+}
+
+void TcpConnection::setCorked(bool on)
+{
+        corked_ = on;
+        if (!on && state_ == kConnected && outputBuffer_.readableBytes() > 0)
+        {
+                flushCorked();
+        }
+}
+
+void TcpConnection::scheduleFlush()
+{
+        // 已经在等EPOLLOUT的连接由handleWrite写
+        if (!flushQueued_ && !channel_->isWriting())
+        {
+                flushQueued_ = true;
+                getLoop()->queueAfterDispatch(std::bind(&TcpConnection::flushCorked, shared_from_this()));
+        }
+}
+
+void TcpConnection::flushCorked()
+{
+        if (!isInLoopThread())
+        {
+                // 登记之后连接迁移走了 到新的loop上再写
+                queueInLoop(std::bind(&TcpConnection::flushCorked, std::placeholders::_1));
+                return;
+        }
+        flushQueued_ = false;
+        if (state_ == kDisconnected || channel_->isWriting() || outputBuffer_.readableBytes() == 0)
+        {
+                return;
+        }
+        if (writeNow())
+        {
+                channel_->enableWriting();
+        }
+}
+
 // 关闭连接
 void TcpConnection::shutdown()
 {
         if (state_ == kConnected)
         {
                 setState(kDisconnecting);
-                loop_->runInLoop(
-                        std::bind(&TcpConnection::shutdownInLoop, this)
+                runInLoop(
+                        std::bind(&TcpConnection::shutdownInLoop, std::placeholders::_1)
                 );
         }
 }
 
 void TcpConnection::shutdownInLoop()
 { 
-        if (!channel_->isWriting()) // 说明outputBuffer中的数据已经全部发送完毕
+        // 说明outputBuffer中的数据已经全部发送完毕 corked时可能还有数据等着本轮结束写出 写完后再关闭
+        if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
         {
                 socket_->shutdownWrite();
         }
 
 }
 
+void TcpConnection::setEdgeTriggered(bool on)
+{
+        channel_->setEdgeTriggered(on);
+}
+
+void TcpConnection::forceClose()
+{
+        if (state_ == kConnected || state_ == kDisconnecting)
+        {
+                setState(kDisconnecting);
+                queueInLoop(
+                        std::bind(&TcpConnection::forceCloseInLoop, std::placeholders::_1)
+                );
+        }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+        if (state_ == kConnected || state_ == kDisconnecting)
+        {
+                handleClose();
+        }
+}
+
+void TcpConnection::post(Task task)
+{
+        // 先登记再检查 和migrateInLoop中先置位再等待的顺序相反 两边至少有一方能看到对方
+        posting_.fetch_add(1);
+        if (!migrating_.load())
+        {
+                getLoop()->queueInLoop(std::move(task));
+                posting_.fetch_sub(1, std::memory_order_release);
+                return;
+        }
+        posting_.fetch_sub(1, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(loopMutex_);
+        getLoop()->queueInLoop(std::move(task));
+}
+
+// Routed任务在不属于连接的线程上被执行
+void TcpConnection::redirect(Task task)
+{
+        {
+                std::lock_guard<std::mutex> lock(loopMutex_);
+                if (migrating_.load(std::memory_order_relaxed))
+                {
+                        // 新loop线程上的是切换之后投递的 其他的是旧loop上切换之前投递的
+                        if (getLoop()->isInLoopThread())
+                        {
+                                parked_.push_back(std::move(task));
+                        }
+                        else
+                        {
+                                forwarded_.push_back(std::move(task));
+                        }
+                        return;
+                }
+        }
+        post(std::move(task));
+}
+
+void TcpConnection::migrateTo(EventLoop* newLoop)
+{
+        if (newLoop->retired())
+        {
+                LOG_ERROR("TcpConnection::migrateTo [%s] target loop %p is retired \n", name_.c_str(), newLoop);
+                return;
+        }
+        // 先在newLoop上占一个名额 迁移完成或放弃之前newLoop不会被线程池回收
+        newLoop->adjustConnections(1);
+        queueInLoop(std::bind(&TcpConnection::migrateInLoop, std::placeholders::_1, newLoop));
+}
+
+// 在旧loop中执行 这时已经处理完本轮的IO事件 activeChannels中不会再有这个channel
+void TcpConnection::migrateInLoop(EventLoop* newLoop)
+{
+        EventLoop* oldLoop = getLoop();
+        if (newLoop == oldLoop || state_ != kConnected || newLoop->retired())
+        {
+                newLoop->adjustConnections(-1);
+                return;
+        }
+        LOG_INFO("TcpConnection::migrateInLoop [%s] fd=%d %p => %p \n", name_.c_str(), channel_->fd(), oldLoop, newLoop);
+
+        // 从旧poller上摘下 这期间到达的数据留在socket的接收缓冲区里 在新loop上注册后再读
+        bool writing = channel_->isWriting();
+        channel_->remove();
+        channel_->setOwnerLoop(newLoop);
+        if (idleEntry_.linked())
+        {
+                oldLoop->timingWheel()->remove(&idleEntry_);
+        }
+
+        std::lock_guard<std::mutex> lock(loopMutex_);
+        migrating_.store(true);
+        // 之后的投递都会走加锁的路径 等已经不加锁读到旧loop的投递入队
+        while (posting_.load(std::memory_order_acquire) > 0)
+        {
+                std::this_thread::yield();
+        }
+        loop_.store(newLoop, std::memory_order_release);
+        // 切换之前投递到旧loop的任务都排在它前面
+        oldLoop->queueInLoop(std::bind(&TcpConnection::handoffInLoop, shared_from_this(), oldLoop, writing));
+}
+
+void TcpConnection::handoffInLoop(EventLoop* oldLoop, bool writing)
+{
+        getLoop()->queueInLoop(std::bind(&TcpConnection::attachInLoop, shared_from_this(), writing));
+        // 交接完成后旧loop上才不再算这个连接 线程池等它归零后才回收旧loop
+        oldLoop->adjustConnections(-1);
+}
+
+void TcpConnection::attachInLoop(bool writing)
+{
+        EventLoop* loop = getLoop();
+        // 之后的slab从新loop的pool中分配 inputBuffer_的分配器还指向旧pool 之后扩容不在它的所属线程 会改用malloc
+        outputBuffer_.setPool(loop->slabPool());
+        channel_->enableReading();
+        // 从旧poller（io_uring）摘下时同步取消的写请求可能已经把数据写完了
+        sent_ = false;
+        if (writing && outputBuffer_.readableBytes() > 0)
+        {
+                channel_->enableWriting();
+        }
+        else if (writing)
+        {
+                outputDrained();
+        }
+        if (loop->busyPollMicros() > 0)
+        {
+                socket_->setBusyPoll(static_cast<int>(loop->busyPollMicros()));
+        }
+        if (idleTimeout_ > 0.0 && state_ == kConnected)
+        {
+                loop->timingWheel()->add(&idleEntry_, idleTimeout_);
+        }
+
+        std::vector<Task> forwarded;
+        std::vector<Task> parked;
+        {
+                std::lock_guard<std::mutex> lock(loopMutex_);
+                migrating_.store(false, std::memory_order_release);
+                forwarded.swap(forwarded_);
+                parked.swap(parked_);
+        }
+        for (Task& task : forwarded)
+        {
+                task();
+        }
+        for (Task& task : parked)
+        {
+                task();
+        }
+        // 从旧loop上摘下时poller（io_uring）已经替连接收了数据 不会再有通知 在这里处理
+        if (received_ && (state_ == kConnected || state_ == kDisconnecting))
+        {
+                handleRead(Timestamp::now());
+        }
+}
+
+void TcpConnection::handleIdleTimeout()
+{
+        LOG_INFO("TcpConnection::handleIdleTimeout [%s] idle for %.1f seconds \n", name_.c_str(), idleTimeout_);
+        forceClose();
+}
+
 // 连接建立
 void TcpConnection::connectEstablished()
 {
         setState(kConnected);
         channel_->tie(shared_from_this());
+        if (zeroCopyThreshold_ > 0)
+        {
+                zeroCopy_ = socket_->setZeroCopy(true);
+                if (!zeroCopy_)
+                {
+                        zeroCopyThreshold_ = 0;
+                }
+        }
         channel_->enableReading(); // 向poller注册channel的epollin事件 
 
+        if (getLoop()->busyPollMicros() > 0)
+        {
+                socket_->setBusyPoll(static_cast<int>(getLoop()->busyPollMicros())); // 所属loop工作在忙轮询模式
+        }
+        if (idleTimeout_ > 0.0)
+        {
+                getLoop()->timingWheel()->add(&idleEntry_, idleTimeout_);
+        }
+
         // 新连接建立 执行回调
         connectionCallback_(shared_from_this());
 }
@@ -188,59 +679,260 @@ void TcpConnection::connectDestroyed()
                 channel_->disableAll(); // 把channel的所有感兴趣事件 从poller中del掉
 
                 connectionCallback_(shared_from_this());
+                resumeWaiters();
+        }
+        if (idleEntry_.linked())
+        {
+                getLoop()->timingWheel()->remove(&idleEntry_);
         }
         channel_->remove(); // 把channel从poller中删除掉
+        if (outputBuffer_.zeroCopyPending())
+        {
+                // 内核还引用着outputBuffer_中的slab 连同socket交给loop 收到完成通知之后再释放
+                // 在loop线程中交出 连接之后在哪个线程析构都不再碰它们 socket留着只用来读错误队列
+                getLoop()->buryZeroCopy(std::move(socket_), std::unique_ptr<ChainBuffer>(new ChainBuffer(std::move(outputBuffer_))));
+        }
+        // 用户代码可能还持有这个连接 但它已经不再使用loop 不计入负载 也不妨碍loop被回收
+        if (counted_)
+        {
+                counted_ = false;
+                getLoop()->adjustConnections(-1);
+        }
+}
+
+void TcpConnection::handleRecvCompletion(const char* data, int res)
+{
+        received_ = true;
+        if (data != nullptr)
+        {
+                inputBuffer_.append(data, res);
+                receivedBytes_ += res;
+        }
+        else
+        {
+                receivedEnd_ = res;
+        }
+}
+
+bool TcpConnection::writesByCompletion() const
+{
+        return channel_->writesByCompletion() && zeroCopyThreshold_ == 0;
+}
+
+int TcpConnection::gatherOutput(struct iovec* vec, int maxIov)
+{
+        if (!writesByCompletion())
+        {
+                return 0; // 零拷贝发送 等可写事件自己sendmsg
+        }
+        int iovcnt = outputBuffer_.fillIovecs(vec, maxIov);
+        if (iovcnt > 0)
+        {
+                outputBuffer_.beginAsyncSend();
+        }
+        return iovcnt;
+}
+
+void TcpConnection::handleWriteCompletion(int res)
+{
+        if (res > 0)
+        {
+                outputBuffer_.retrieve(res);
+        }
+        outputBuffer_.endAsyncSend();
+        if (res != -ECANCELED)
+        {
+                sent_ = true;
+                sentResult_ = res;
+        }
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
         int savedErrno = 0;
-        ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-        if (n > 0)
+        ssize_t n = 0;
+        ssize_t total = 0;
+        bool reachedCap = false;
+        if (received_)
+        {
+                // poller已经把数据收进了inputBuffer_ 不需要再读 n和savedErrno按最后一次读的结果填写
+                total = receivedBytes_;
+                n = receivedEnd_ > 0 ? total : (receivedEnd_ == 0 ? 0 : -1);
+                savedErrno = receivedEnd_ < 0 ? -receivedEnd_ : 0;
+                received_ = false;
+                receivedBytes_ = 0;
+                receivedEnd_ = 1;
+        }
+        else
+        {
+                n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+                total = n;
+                if (n > 0 && channel_->isEdgeTriggered())
+                {
+                        // ET模式下内核不会再次通知 需要一直读到EAGAIN
+                        // 每个事件最多读kMaxIoPerEvent次、kMaxReadBytesPerEvent字节 剩下的等下一轮其他channel处理完再读
+                        // 既保证同一loop上其他连接的公平 也让messageCallBack_每次处理的数据和LT模式差不多
+                        for (int reads = 1; ; ++reads)
+                        {
+                                if (reads >= kMaxIoPerEvent || total >= kMaxReadBytesPerEvent)
+                                {
+                                        reachedCap = true;
+                                        break;
+                                }
+                                n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+                                if (n <= 0)
+                                {
+                                        break;
+                                }
+                                total += n;
+                        }
+                }
+        }
+
+        if (total > 0)
         {
-                // 已建立连接的用户，有可读事件发生了，调用用户传入的回调函数
-                messageCallBack_(shared_from_this(), &inputBuffer_, receiveTime);
+                if (idleEntry_.linked())
+                {
+                        getLoop()->timingWheel()->touch(&idleEntry_, idleTimeout_); // O(1)重新计时
+                }
+                if (readWaiter_ != nullptr)
+                {
+                        // 有协程在等数据 条件满足时恢复它 它自己从inputBuffer_中取走数据
+                        if (readWaiter_->ready())
+                        {
+                                IoWaiter* waiter = readWaiter_;
+                                readWaiter_ = nullptr;
+                                waiter->resume();
+                        }
+                }
+                else if (messageCallBack_)
+                {
+                        // 已建立连接的用户，有可读事件发生了，调用用户传入的回调函数
+                        messageCallBack_(shared_from_this(), &inputBuffer_, receiveTime);
+                }
+
+                if (n == 0 && state_ != kDisconnected)
+                {
+                        handleClose(); // ET模式下数据和FIN在同一次通知中读到
+                }
+                else if (n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+                {
+                        errno = savedErrno;
+                        LOG_ERROR("TcpConnection::handleRead errno=%d n=%ld \n", savedErrno, (long)n);
+                        handleError();
+                }
+                else if (reachedCap)
+                {
+                        getLoop()->queueNextIteration(
+                                std::bind(&TcpConnection::continueRead, shared_from_this(), receiveTime)
+                        );
+                }
         }
         else if (n == 0)
         {
                 handleClose();
         }
+        else if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+                // ET模式下数据已经被continueRead读完 或者迁移后重新注册时报告的就绪 不是错误
+        }
         else
         {
                 errno = savedErrno;
-                LOG_ERROR("TcpConnection::handleRead");
+                LOG_ERROR("TcpConnection::handleRead \n");
                 handleError();
         }
 }
 
+// 投递的是成员函数而不是用户回调的拷贝 拷贝std::function可能要分配内存
+void TcpConnection::notifyWriteComplete()
+{
+        if (writeCompleteCallback_)
+        {
+                writeCompleteCallback_(shared_from_this());
+        }
+}
+
+void TcpConnection::notifyHighWaterMark(size_t len)
+{
+        if (highWaterMarkCallback_)
+        {
+                highWaterMarkCallback_(shared_from_this(), len);
+        }
+}
+
+void TcpConnection::continueRead(Timestamp receiveTime)
+{
+        if (!isInLoopThread())
+        {
+                // 登记之后连接迁移走了 到新的loop上再读
+                queueInLoop(std::bind(&TcpConnection::continueRead, std::placeholders::_1, receiveTime));
+                return;
+        }
+        if (state_ == kConnected || state_ == kDisconnecting)
+        {
+                handleRead(receiveTime);
+        }
+}
+
 void TcpConnection::handleWrite()
 {
         if (channel_->isWriting())
         {
                 int savedErrno = 0;
-                ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-                if (n > 0)
+                ssize_t n = 0;
+                bool wrote = false;
+                int writes = 0;
+                const bool completed = sent_;
+                if (completed)
                 {
-                        outputBuffer_.retrieve(n);
-                        if (outputBuffer_.readableBytes() == 0)
+                        // poller已经替连接写了并且retrieve过 n和savedErrno按写的结果填写 还有数据时poller下一轮再提交
+                        n = sentResult_ >= 0 ? sentResult_ : -1;
+                        savedErrno = sentResult_ < 0 ? -sentResult_ : 0;
+                        wrote = n > 0;
+                        sent_ = false;
+                }
+                else
+                {
+                        // LT模式下每次事件写一次 ET模式下一直写到缓冲区清空、EAGAIN或者达到公平上限
+                        do
                         {
-                                channel_->disableWriting();
-                                if (writeCompleteCallback_)
-                                {
-                                        // 唤醒loop_ 对应的thread，执行回调函数
-                                        loop_->queueInLoop(
-                                                std::bind(writeCompleteCallback_, shared_from_this())
-                                        );
-                                }
-                                if (state_ == kDisconnecting)
+                                n = outputBuffer_.writeFd(channel_->fd(), &savedErrno, zeroCopyThreshold_);
+                                if (n > 0)
                                 {
-                                        shutdownInLoop();
+                                        outputBuffer_.retrieve(n);
+                                        wrote = true;
                                 }
+                                ++writes;
+                        } while (channel_->isEdgeTriggered()
+                                && n > 0
+                                && outputBuffer_.readableBytes() > 0
+                                && writes < kMaxIoPerEvent);
+                }
+
+                if (wrote)
+                {
+                        if (outputBuffer_.readableBytes() == 0)
+                        {
+                                channel_->disableWriting();
+                                outputDrained();
+                        }
+                        else if (n > 0 && channel_->isEdgeTriggered() && !completed)
+                        {
+                                // 达到公平上限 socket仍然可写 不会再有新的边缘通知
+                                getLoop()->queueNextIteration(
+                                        std::bind(&TcpConnection::continueWrite, shared_from_this())
+                                );
                         }
                 }
-                else
+                else if (!(channel_->isEdgeTriggered() && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)))
                 {
-                        LOG_ERROR("TcpConnection::handleWrite");
+                        LOG_ERROR("TcpConnection::handleWrite \n");
+                        if (savedErrno == EIO)
+                        {
+                                // sendFile的文件读失败或者比指定的短 后面的数据没法按顺序发出 只能断开
+                                forceCloseInLoop();
+                        }
                 }
         }
         else
@@ -250,20 +942,67 @@ void TcpConnection::handleWrite()
         
 }
 
+void TcpConnection::continueWrite()
+{
+        if (!isInLoopThread())
+        {
+                queueInLoop(std::bind(&TcpConnection::continueWrite, std::placeholders::_1));
+                return;
+        }
+        if (state_ != kDisconnected && channel_->isWriting())
+        {
+                handleWrite();
+        }
+}
+
 // poller => channel::closeCallback => TcpConnection::handleClose => TcpConnection::connectionCallback_ => TcpServer::closeCallback_
 void TcpConnection::handleClose()
 {
         LOG_INFO("TcpConnection::handleClose fd = %d state = %d \n", channel_->fd(), (int)state_);
         setState(kDisconnected);
         channel_->disableAll();
+        if (idleEntry_.linked())
+        {
+                getLoop()->timingWheel()->remove(&idleEntry_);
+        }
 
         TcpConnectionPtr connPtr(shared_from_this());
         connectionCallback_(connPtr); // 执行连接关闭的回调
+        resumeWaiters();
         closeCallback_(connPtr); // 关闭连接的回调 执行的是TcpServer::removeConnection回调方法
 }
 
+void TcpConnection::resumeWriteWaiter()
+{
+        if (writeWaiter_ != nullptr && writeWaiter_->ready())
+        {
+                IoWaiter* waiter = writeWaiter_;
+                writeWaiter_ = nullptr;
+                waiter->resume();
+        }
+}
+
+void TcpConnection::resumeWaiters()
+{
+        if (readWaiter_ != nullptr)
+        {
+                IoWaiter* waiter = readWaiter_;
+                readWaiter_ = nullptr;
+                waiter->resume();
+        }
+        if (writeWaiter_ != nullptr)
+        {
+                IoWaiter* waiter = writeWaiter_;
+                writeWaiter_ = nullptr;
+                waiter->resume();
+        }
+}
+
 void TcpConnection::handleError()
 {
+        // 零拷贝发送的完成通知也通过EPOLLERR报告 不是真正的错误
+        int completions = zeroCopy_ ? handleZeroCopyCompletions() : 0;
+
         int optval;
         socklen_t optlen = sizeof(optval);
         int err = 0;
@@ -275,5 +1014,22 @@ void TcpConnection::handleError()
         {
                 err = optval;
         }
+        if (err == 0 && completions > 0)
+        {
+                return;
+        }
         LOG_ERROR("TcpConnection::handleError name = %s - SO_ERROR = %d \n", name_.c_str(), err);
 }
+
+int TcpConnection::handleZeroCopyCompletions()
+{
+        bool kernelCopied = false;
+        int completions = outputBuffer_.readZeroCopyCompletions(channel_->fd(), &kernelCopied);
+        if (kernelCopied && zeroCopyThreshold_ > 0)
+        {
+                // 内核还是拷贝了 零拷贝只剩下锁页和通知的开销 这个连接之后不再使用
+                LOG_DEBUG("TcpConnection::handleZeroCopyCompletions [%s] kernel copied, disable zero copy \n", name_.c_str());
+                zeroCopyThreshold_ = 0;
+        }
+        return completions;
+}
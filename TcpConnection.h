@@ -4,14 +4,25 @@
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
+#include "ChainBuffer.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
+#include "ComputePool.h"
+#include "EventLoop.h"
+#include "Task.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <mutex>
+#include <vector>
 
 class Channel;
-class EventLoop;
+#ifdef __cpp_impl_coroutine
+class ReadAtLeastAwaiter;
+class ReadUntilAwaiter;
+class WriteAwaiter;
+#endif
 class Socket;
 
 
@@ -29,17 +40,43 @@ public:
                         const InetAddress& peerAddr);
         ~TcpConnection();
 
-        EventLoop* getLoop() const { return loop_; }
+        // 连接迁移后会变成新的loop
+        EventLoop* getLoop() const { return loop_.load(std::memory_order_acquire); }
         const std::string& name() const { return name_; }
         const InetAddress& localAddress() { return localAddr_; }
         const InetAddress& peerAddress() { return peerAddr_; }
 
         bool connected() const { return state_ == kConnected; }
 
-        // 发送数据
+        // 发送数据 在其他线程调用时先拷贝一份再投递
         void send(const std::string &buf);
+        // 接管数据 不再拷贝 可以在任意线程调用 发不完的部分直接挂在outputBuffer_上
+        void send(std::string&& buf);
+        void send(Buffer&& buf);
+        // 多段数据按顺序一起发送 和outputBuffer_中已有的数据一次writev写出
+        void send(std::vector<std::string>&& slices);
+        // 发送文件的[offset, offset + length) 和前后send的数据按顺序发出 用sendfile 数据不经过用户态
+        // fd会先dup一份 调用之后可以马上关闭 可以在任意线程调用 发完之后触发WriteCompleteCallback
+        void sendFile(int fd, off_t offset, size_t length);
         // 关闭连接
         void shutdown();
+        // 强制关闭连接 不等待outputBuffer中的数据发送完毕
+        void forceClose();
+
+        // 以EPOLLET注册 读写时一直到EAGAIN 需要在connectEstablished之前设置
+        void setEdgeTriggered(bool on);
+
+        // 空闲超时 seconds秒内没有收到数据就强制关闭连接 需要在connectEstablished之前设置 0表示不启用
+        void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+        // outputBuffer_一次写出的数据不少于bytes时用MSG_ZEROCOPY发送 需要在connectEstablished之前设置 0表示不启用
+        // 只用于缓冲区自己持有的内存（接管的string/Buffer 排队中的数据）调用者借给send的内存照常write
+        // 内核不支持SO_ZEROCOPY或者报告发生了拷贝（比如回环和不支持SG的网卡）时自动退回普通发送
+        void setZeroCopyThreshold(size_t bytes) { zeroCopyThreshold_ = bytes; }
+
+        // corked模式下send只追加到outputBuffer_ 本轮事件分发结束后每个有数据的连接用一次writev写出
+        // 一个响应分几次send时减少系统调用和小包 在loop线程中调用或者在connectEstablished之前设置 关闭时立即写出
+        void setCorked(bool on);
 
         void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
         void setMessageCallBack(const MessageCallBack& cb) { messageCallBack_ = cb; }
@@ -47,6 +84,57 @@ public:
         void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark) { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
         void setCloseCallback(const CloseCallback& cb) { closeCallback_ = cb; }
 
+        // 迁移到newLoop 可以在任意线程调用 在当前loop处理完本轮事件之后进行
+        // channel从当前loop的poller上摘下再注册到newLoop上 输入输出缓冲区、状态和空闲计时原样保留 socket中的数据不会丢失
+        // 迁移过程中投递给这个连接的任务（send、shutdown等）按原来的顺序在newLoop上执行
+        // 连接已经不处于kConnected或者newLoop已经从线程池中移除时什么都不做 调用时newLoop必须还活着
+        void migrateTo(EventLoop* newLoop);
+
+        // 在连接所属的loop中执行f(conn) 当前就在该loop线程中时直接执行
+        // 和直接投递给getLoop()不同 迁移过程中排队的任务会按提交顺序转到新的loop上执行
+        template <typename F>
+        void runInLoop(F f)
+        {
+                if (isInLoopThread())
+                {
+                        f(shared_from_this());
+                }
+                else
+                {
+                        queueInLoop(std::move(f));
+                }
+        }
+        template <typename F>
+        void queueInLoop(F f)
+        {
+                post(Task(Routed<F>(shared_from_this(), std::move(f))));
+        }
+
+        // 协程等待读写时挂在连接上的等待者 由Coroutine.h中的awaiter实现 只在所属loop线程中使用
+        struct IoWaiter
+        {
+                virtual ~IoWaiter() {}
+                virtual bool ready() = 0;  // 等待的条件是否已经满足
+                virtual void resume() = 0; // 恢复等待的协程
+        };
+        // 有读等待者时收到的数据交给它 不再调用MessageCallBack 条件满足或者连接断开时恢复
+        void setReadWaiter(IoWaiter* waiter) { readWaiter_ = waiter; }
+        // outputBuffer发送完毕或者连接断开时恢复
+        void setWriteWaiter(IoWaiter* waiter) { writeWaiter_ = waiter; }
+        Buffer* inputBuffer() { return &inputBuffer_; }
+        ChainBuffer* outputBuffer() { return &outputBuffer_; }
+
+#ifdef __cpp_impl_coroutine
+        // C++20协程接口 定义在Coroutine.h中 在连接所属loop线程上运行的协程中co_await
+        ReadAtLeastAwaiter readAtLeast(size_t n);
+        ReadUntilAwaiter readUntil(const std::string& delim);
+        WriteAwaiter write(std::string data);
+#endif
+
+        // TcpServer::offload使用的串行执行器 第一次offload时创建 只在所属loop线程中访问
+        const std::shared_ptr<ComputePool::Strand>& computeStrand() const { return computeStrand_; }
+        void setComputeStrand(const std::shared_ptr<ComputePool::Strand>& strand) { computeStrand_ = strand; }
+
         // 连接建立
         void connectEstablished();
         // 连接销毁
@@ -54,23 +142,94 @@ public:
 
 private: 
         enum StateE { kConnecting, kConnected, kDisconnecting, kDisconnected };
+
+        // 投递给连接的任务 执行时如果连接已经不属于当前loop 交给迁移流程按顺序转交
+        template <typename F>
+        struct Routed
+        {
+                Routed(std::shared_ptr<TcpConnection>&& c, F&& f) : conn(std::move(c)), fn(std::move(f)) {}
+
+                void operator()()
+                {
+                        TcpConnection* c = conn.get();
+                        if (c->isInLoopThread())
+                        {
+                                fn(conn);
+                        }
+                        else
+                        {
+                                c->redirect(Task(std::move(*this)));
+                        }
+                }
+
+                std::shared_ptr<TcpConnection> conn;
+                F fn;
+        };
+
+        // 在所属loop线程中且不在迁移中
+        bool isInLoopThread() const
+        {
+                return getLoop()->isInLoopThread() && !migrating_.load(std::memory_order_acquire);
+        }
+        void post(Task task);
+        void redirect(Task task);
+        // 迁移分三步 旧loop上摘下channel并切换loop_ 旧loop执行完切换前投递的任务后交接 新loop上重新注册
+        void migrateInLoop(EventLoop* newLoop);
+        void handoffInLoop(EventLoop* oldLoop, bool writing);
+        void attachInLoop(bool writing);
+
         void setState(StateE s) { state_ = s; }
+        // 完成式接收时poller交来的数据或者结束状态 先放进inputBuffer_ 随后的handleRead再处理
+        void handleRecvCompletion(const char* data, int res);
+        // 完成式写 poller（io_uring）收集outputBuffer_中待发送的数据 完成时交来结果 retrieve之后由handleWrite处理
+        int gatherOutput(struct iovec* vec, int maxIov);
+        void handleWriteCompletion(int res);
+        // poller替连接提交写请求时不直接write 零拷贝发送仍然自己写
+        bool writesByCompletion() const;
         void handleRead(Timestamp receiveTime);
         void handleWrite();
+        // ET模式下达到公平上限后 在下一轮的IO事件之后继续读/写
+        void continueRead(Timestamp receiveTime);
+        void continueWrite();
+        // 在loop中调用用户的写完成/高水位回调
+        void notifyWriteComplete();
+        void notifyHighWaterMark(size_t len);
         void handleClose();
         void handleError();
+        void resumeWriteWaiter();
+        // 连接断开时恢复所有等待中的协程 它们会看到连接已经断开
+        void resumeWaiters();
 
 
         void sendInLoop(const void* message, size_t len);
+        void sendStringInLoop(std::string& buf);
+        void sendBufferInLoop(Buffer& buf);
+        void sendSlicesInLoop(std::vector<std::string>& slices);
+        void sendFileInLoop(int fd, off_t offset, size_t length);
+        // 新数据已经追加到outputBuffer_ oldLen是追加之前的长度
+        void flushAppended(size_t oldLen);
+        // 立即写一次outputBuffer_ 返回是否还有数据要等EPOLLOUT
+        bool writeNow();
+        // outputBuffer_发送完了 恢复等待的协程、调用写完成回调 正在关闭时关闭写端
+        void outputDrained();
+        // corked模式下登记本轮结束时的写出
+        void scheduleFlush();
+        void flushCorked();
         void shutdownInLoop();
+        void forceCloseInLoop();
+        // 时间轮上的空闲超时到期
+        void handleIdleTimeout();
+        // 读完错误队列中的零拷贝完成通知 返回读到的通知数
+        int handleZeroCopyCompletions();
         
-        EventLoop* loop_;  // 绝对不是baseLoop 因为TcpConnection都是在subloop中管理的
+        std::atomic<EventLoop*> loop_;  // 绝对不是baseLoop 因为TcpConnection都是在subloop中管理的 迁移时在旧loop线程中修改
         const std::string name_;
         std::atomic_int state_;  
         bool reading_;
+        bool counted_; // 是否计入所属loop的连接数 connectDestroyed之后不再计入
 
         // 与Acceptor类似  Acceptor => mainloop  TcpConnection => subloop
-        std::unique_ptr<Socket> socket_;
+        std::unique_ptr<Socket> socket_; // 零拷贝发送没完成时connectDestroyed把它交给loop 之后为空
         std::unique_ptr<Channel> channel_;
 
         const InetAddress localAddr_;
@@ -82,7 +241,32 @@ private:
         HighWaterMarkCallback highWaterMarkCallback_; // 缓冲区高水位回调
         CloseCallback closeCallback_; // 连接关闭时的回调
         size_t highWaterMark_;
+        size_t zeroCopyThreshold_; // 0表示不用零拷贝发送
+        bool zeroCopy_;            // socket开启了SO_ZEROCOPY 需要读错误队列
+        bool corked_;              // send只追加 本轮结束时统一写出
+        bool flushQueued_;         // 已经登记了本轮结束时的写出
 
         Buffer inputBuffer_;  // 接受数据缓冲区
-        Buffer outputBuffer_; // 发送数据缓冲区
+        bool received_;          // poller已经替连接收了数据（io_uring）还没交给handleRead处理
+        ssize_t receivedBytes_;  // 其中收进inputBuffer_的字节数
+        int receivedEnd_;        // 1表示还没结束 0表示对端关闭 负数是-errno
+        ChainBuffer outputBuffer_; // 发送数据缓冲区 积压很多时也不会整体搬动或扩容拷贝
+        bool sent_;              // poller已经替连接写了（io_uring）还没交给handleWrite处理
+        int sentResult_;         // 写出的字节数或者-errno
+
+        double idleTimeout_;  // 空闲超时秒数
+        TimingWheel::Entry idleEntry_; // 挂在所属loop时间轮上的节点 每次handleRead重新计时
+
+        std::shared_ptr<ComputePool::Strand> computeStrand_; // 保证这个连接offload的任务按顺序执行
+
+        IoWaiter* readWaiter_;  // 等待数据的协程
+        IoWaiter* writeWaiter_; // 等待outputBuffer发送完毕的协程
+
+        // 迁移中投递任务时读loop_和入队在锁内完成 和迁移时切换loop_互斥 切换之前投递的任务一定排在交接任务之前
+        // 不在迁移中时不加锁 切换loop_之前等posting_归零 已经看到migrating_为false的投递都排在交接任务之前
+        std::mutex loopMutex_;
+        std::atomic_bool migrating_;    // 从切换loop_到在新loop上注册完成之间为true
+        std::atomic_int posting_;       // 正在不加锁投递的线程数
+        std::vector<Task> forwarded_;   // 迁移中旧loop上执行到的任务 在新loop上先执行
+        std::vector<Task> parked_;      // 迁移中直接投递到新loop的任务 在forwarded_之后执行
 };
\ No newline at end of file
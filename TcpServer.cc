@@ -3,7 +3,9 @@
 #include "TcpConnection.h"
 
 #include <functional>
+#include <future>
 #include <strings.h>
+#include <unistd.h>
 
 static EventLoop* CheckLoopNotNull(EventLoop* loop)
 {
@@ -19,14 +21,22 @@ TcpServer::TcpServer(EventLoop *loop,
                         const std::string &nameArg,
                         Option option )
                         : loop_(CheckLoopNotNull(loop))
+                        , listenAddr_(listenAddr)
                         , ipPort_(listenAddr.toIpPort())
                         , name_(nameArg)
                         , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
                         , threadPool_(new EventLoopThreadPool(loop, name_ ))
+                        , computePool_(new ComputePool(name_ + "-compute"))
                         , connectionCallback_()
                         , messageCallBack_()
-                        , nextConnId_(1)
                         , started_(0)
+                        , nextConnId_(1)
+                        , idleTimeout_(0.0)
+                        , zeroCopyThreshold_(0)
+                        , corked_(false)
+                        , edgeTriggered_(false)
+                        , reusePort_(option == kReusePort)
+                        , acceptMode_(kAcceptInBaseLoop)
 {
         // 当有新用户连接时，会调用TcpServer::newConnection函数
         acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, 
@@ -36,18 +46,43 @@ TcpServer::TcpServer(EventLoop *loop,
 TcpServer::~TcpServer()
 {
         LOG_INFO("TcpServer::~TcpServer [%s] destructing \n", name_.c_str());
-        for (auto &item : connections_)
+        // subloop上的Acceptor要在它自己的loop线程里销毁 等它真正从poller上摘掉再继续
+        for (auto &acceptor : loopAcceptors_)
+        {
+                EventLoop *ioLoop = acceptor->getLoop();
+                if (ioLoop->isInLoopThread())
+                {
+                        acceptor.reset();
+                        continue;
+                }
+                Acceptor *raw = acceptor.release();
+                std::promise<void> done;
+                ioLoop->runInLoop([raw, &done]() {
+                        delete raw;
+                        done.set_value();
+                });
+                done.get_future().wait();
+        }
+
         {
-                 // 防止对象直接被释放 且出了该函数后对象会被释放
-                 // 这个局部的shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象
-                TcpConnectionPtr conn(item.second);
-                item.second.reset();
+                std::lock_guard<std::mutex> lock(connectionsMutex_);
+                for (auto &item : connections_)
+                {
+                         // 防止对象直接被释放 且出了该函数后对象会被释放
+                         // 这个局部的shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象
+                        TcpConnectionPtr conn(item.second);
+                        item.second.reset();
+
+                        // 销毁对象 
+                        conn->runInLoop(std::bind(&TcpConnection::connectDestroyed, std::placeholders::_1));
+                }
+        }
 
-                // 销毁对象 
-                conn->getLoop()->runInLoop(
-                        std::bind(&TcpConnection::connectDestroyed, conn)
-                );
-                conn.reset();
+        // 还在移除中的loop 不再等它的连接迁完 先取消检查的定时器 再quit并join
+        if (!retiringLoops_.empty())
+        {
+                loop_->cancel(retireTimer_);
+                retiringLoops_.clear();
         }
 }
 
@@ -57,24 +92,153 @@ void TcpServer::setThreadNum(int numThreads)
         threadPool_->setThreadNum(numThreads);
 }
 
+void TcpServer::resizeThreadPool(int numThreads)
+{
+        if (acceptMode_ != kAcceptInBaseLoop)
+        {
+                LOG_ERROR("TcpServer::resizeThreadPool [%s] only supported in kAcceptInBaseLoop mode \n", name_.c_str());
+                return;
+        }
+        loop_->runInLoop(std::bind(&TcpServer::resizeThreadPoolInLoop, this, numThreads));
+}
+
+void TcpServer::resizeThreadPoolInLoop(int numThreads)
+{
+        if (!threadPool_->started())
+        {
+                threadPool_->setThreadNum(numThreads);
+                return;
+        }
+        while (threadPool_->numLoops() < static_cast<size_t>(numThreads))
+        {
+                EventLoop *ioLoop = threadPool_->addLoop();
+                LOG_INFO("TcpServer::resizeThreadPool [%s] add loop %p \n", name_.c_str(), ioLoop);
+        }
+        bool retiring = !retiringLoops_.empty();
+        while (threadPool_->numLoops() > static_cast<size_t>(numThreads > 0 ? numThreads : 0))
+        {
+                EventLoop *ioLoop = threadPool_->getAllLoops().back();
+                RetiringLoop retired;
+                retired.loop = ioLoop;
+                retired.thread = threadPool_->removeLoop(ioLoop);
+                // 先从线程池中摘掉 新连接不会再分给它 也不会再有连接迁入
+                ioLoop->setRetired();
+                LOG_INFO("TcpServer::resizeThreadPool [%s] remove loop %p \n", name_.c_str(), ioLoop);
+                retiringLoops_.push_back(std::move(retired));
+        }
+        if (!retiring && !retiringLoops_.empty())
+        {
+                // 全部结束时由checkRetiringLoops取消
+                retireTimer_ = loop_->runEvery(kRetireCheckSeconds, std::bind(&TcpServer::checkRetiringLoops, this));
+                checkRetiringLoops();
+        }
+}
+
+// 把正在移除的loop上的连接迁走 连接数归零后结束loop线程 在baseLoop中执行
+// 正在迁入的连接迁入完成后会在下一次检查时被再迁走 正在关闭的连接等它connectDestroyed
+// 零拷贝发送的内存等到完成通知释放之后再结束
+void TcpServer::checkRetiringLoops()
+{
+        for (auto it = retiringLoops_.begin(); it != retiringLoops_.end(); )
+        {
+                EventLoop *ioLoop = it->loop;
+                // 还在等零拷贝完成通知的连接也要等完 loop析构时只能放弃这些内存
+                if (ioLoop->numConnections() == 0 && ioLoop->numZeroCopyGraves() == 0)
+                {
+                        LOG_INFO("TcpServer::retireLoop [%s] loop %p \n", name_.c_str(), ioLoop);
+                        it = retiringLoops_.erase(it); // quit并join loop线程
+                        continue;
+                }
+
+                std::lock_guard<std::mutex> lock(connectionsMutex_);
+                for (auto &item : connections_)
+                {
+                        const TcpConnectionPtr &conn = item.second;
+                        if (conn->getLoop() == ioLoop)
+                        {
+                                conn->migrateTo(threadPool_->getLoopForConnection(conn->peerAddress()));
+                        }
+                }
+                ++it;
+        }
+        if (retiringLoops_.empty())
+        {
+                loop_->cancel(retireTimer_);
+        }
+}
+
 // 开启服务器监听 loop.loop()
 void TcpServer::start()
 {
        if (started_++ == 0)  // 防止一个TcpServer被start多次
        {
                 threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
-                loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+                computePool_->start();
+                if (acceptMode_ == kAcceptInBaseLoop)
+                {
+                        acceptor_->setEdgeTriggered(edgeTriggered_);
+                        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+                }
+                else
+                {
+                        startLoopAcceptors();
+                }
        } 
 }
 
+// 每个subloop各自accept 新连接就地建立在accept它的loop上
+void TcpServer::startLoopAcceptors()
+{
+        // 构造时在baseLoop上创建的listenfd还没有listen 先释放掉端口 再由各个loop重新bind
+        acceptor_.reset();
+
+        std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+        for (size_t i = 0; i < loops.size(); ++i)
+        {
+                EventLoop *ioLoop = loops[i];
+                Acceptor *acceptor = nullptr;
+                if (acceptMode_ == kAcceptPerLoopReusePort)
+                {
+                        // 每个loop一个独立的listenfd 内核在它们之间分发连接
+                        acceptor = new Acceptor(ioLoop, listenAddr_, true);
+                }
+                else if (i == 0)
+                {
+                        acceptor = new Acceptor(ioLoop, listenAddr_, reusePort_);
+                        acceptor->setExclusive(true);
+                }
+                else
+                {
+                        // 共享第一个loop的listenfd 每个loop持有一个dup出来的fd 各自注册到自己的epoll上
+                        int listenfd = ::dup(loopAcceptors_[0]->fd());
+                        if (listenfd < 0)
+                        {
+                                LOG_FATAL("%s:%s:%d dup listenfd err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+                        }
+                        acceptor = new Acceptor(ioLoop, listenfd);
+                        acceptor->setExclusive(true);
+                }
+                acceptor->setEdgeTriggered(edgeTriggered_);
+                acceptor->setNewConnectionCallback(std::bind(&TcpServer::newConnectionInLoop, this, ioLoop,
+                        std::placeholders::_1, std::placeholders::_2));
+                loopAcceptors_.emplace_back(acceptor);
+                ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+        }
+}
+
 // 有一个新的客户端的连接，Acceptor会执行这个回调
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-        // 轮询算法，从线程池中选择一个subloop，来管理channel
-        EventLoop *ioLoop = threadPool_->getNextLoop();
+        // 按选择策略（默认轮询）从线程池中选择一个subloop，来管理channel
+        EventLoop *ioLoop = threadPool_->getLoopForConnection(peerAddr);
+        newConnectionInLoop(ioLoop, sockfd, peerAddr);
+}
+
+// 在ioLoop上为sockfd建立连接 baseLoop accept时ioLoop是轮询选出来的 per-loop accept时就是当前loop
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
         char buf[64] = {0};
-        snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-        ++nextConnId_;
+        snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_++);
         std::string connName = name_ + buf;
         LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
                 name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
@@ -98,11 +262,18 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
                                 localAddr, 
                                 peerAddr));
 
-        connections_[connName] = conn;
+        {
+                std::lock_guard<std::mutex> lock(connectionsMutex_);
+                connections_[connName] = conn;
+        }
         // 下面的回调都是用户设置给TcpServer => TcpConnection => Channel => Poller => notify channel调用回调
         conn->setConnectionCallback(connectionCallback_);
         conn->setMessageCallBack(messageCallBack_);
         conn->setWriteCompleteCallback(writeCompleteCallback_);
+        conn->setIdleTimeout(idleTimeout_);
+        conn->setEdgeTriggered(edgeTriggered_);
+        conn->setZeroCopyThreshold(zeroCopyThreshold_);
+        conn->setCorked(corked_);
 
         //设置了如何关闭连接的回调
         conn->setCloseCallback(
@@ -110,11 +281,17 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
         );
 
         // 直接调用TcpConnection::connectEstablished
-        ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+        ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, std::move(conn)));
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 {
+        // per-loop accept模式下连接从头到尾都在自己的loop上 就地移除即可
+        if (acceptMode_ != kAcceptInBaseLoop)
+        {
+                removeConnectionInLoop(conn);
+                return;
+        }
         loop_->runInLoop(
                 std::bind(&TcpServer::removeConnectionInLoop, this, conn)
         );
@@ -125,9 +302,10 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
         LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s \n",
                 name_.c_str(), conn->name().c_str());
 
-        connections_.erase(conn->name());
-        EventLoop *ioLoop = conn->getLoop();
-        ioLoop->queueInLoop(
-                std::bind(&TcpConnection::connectDestroyed, conn)
-        );
+        {
+                std::lock_guard<std::mutex> lock(connectionsMutex_);
+                connections_.erase(conn->name());
+        }
+        // 连接可能正在迁移 通过连接自己投递 保证在它最终所属的loop上执行
+        conn->queueInLoop(std::bind(&TcpConnection::connectDestroyed, std::placeholders::_1));
 }
@@ -11,12 +11,16 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "ComputePool.h"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include <vector>
 #include <unordered_map>
+#include <type_traits>
 
 // 对外的服务器编程使用的类
 class TcpServer : noncopyable
@@ -30,6 +34,14 @@ public:
                 kReusePort,
         };
 
+        // 由哪些loop负责accept新连接
+        enum AcceptMode
+        {
+                kAcceptInBaseLoop,       // 默认 baseLoop上一个Acceptor accept之后轮询分发给subloop
+                kAcceptPerLoopReusePort, // 每个subloop各自一个SO_REUSEPORT的listenfd 由内核按四元组哈希把连接分到各个loop
+                kAcceptPerLoopExclusive, // 所有subloop共享同一个listenfd 以EPOLLEXCLUSIVE注册 每个新连接只唤醒一个loop
+        };
+
         TcpServer(EventLoop *loop,
                         const InetAddress &listenAddr,
                         const std::string &nameArg,
@@ -44,24 +56,124 @@ public:
         
         // 设置底层subloop个数
         void setThreadNum(int numThreads);
+        // 运行时调整subloop个数 可以在任意线程调用 在baseLoop中执行 只支持kAcceptInBaseLoop模式
+        // 增加的loop立即参与分配新连接 减少时移除最后加入的loop 它上面的连接按选择策略迁移到剩下的loop上
+        // 迁移完成后该loop线程退出 减到0时连接都迁到baseLoop上
+        void resizeThreadPool(int numThreads);
+
+        // 新连接分配给哪个subloop 默认轮询 只影响kAcceptInBaseLoop模式
+        void setLoopSelection(LoopSelector::Strategy strategy)
+        {
+                threadPool_->setLoopSelector(LoopSelector::newSelector(strategy));
+        }
+
+        // 底层的loop线程池 可以用来获取各个loop的运行统计
+        std::shared_ptr<EventLoopThreadPool> threadPool() const { return threadPool_; }
+
+        // 边缘触发模式 listenfd和所有连接都以EPOLLET注册 读写accept都循环到EAGAIN 需要在start之前设置
+        void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+
+        // 连接空闲超时 seconds秒内没有收到数据的连接会被关闭 0表示不启用
+        // 超时由每个subloop自己的时间轮管理 不需要每个连接一个定时器
+        void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+        // 新连接一次写出不少于bytes的数据时用MSG_ZEROCOPY发送 见TcpConnection::setZeroCopyThreshold 0表示不启用
+        void setZeroCopyThreshold(size_t bytes) { zeroCopyThreshold_ = bytes; }
+
+        // 新连接使用corked模式 见TcpConnection::setCorked
+        void setCorked(bool on) { corked_ = on; }
+
+        // accept模式 需要在start之前设置
+        // 后两种模式下连接由accept它的subloop直接建立 不经过baseLoop 也不再需要跨线程唤醒
+        void setAcceptMode(AcceptMode mode) { acceptMode_ = mode; }
+
+        // 计算线程池的线程数 需要在start之前设置 默认每个CPU一个线程 0表示不启用 这时调用offload会LOG_FATAL
+        void setComputeThreadNum(int numThreads) { computePool_->setThreadNum(numThreads); }
+        ComputePool* computePool() const { return computePool_.get(); }
+
+        // 把CPU密集的work交给计算线程池执行 调用立即返回 不会等待线程池
+        // work的返回值在conn所属的loop线程中交给done(conn, result) work返回void时调用done(conn)
+        // 同一个连接offload的任务按提交顺序执行 done也按这个顺序被调用
+        // 需要在conn所属的loop线程中调用（比如在MessageCallBack里） 连接已经断开时done照样会被调用 需要自己检查conn->connected()
+        template <typename Work, typename Done>
+        void offload(const TcpConnectionPtr &conn, Work work, Done done)
+        {
+                if (!conn->computeStrand())
+                {
+                        conn->setComputeStrand(computePool_->newStrand());
+                }
+                conn->computeStrand()->post(OffloadTask<Work, Done>(conn, std::move(work), std::move(done)));
+        }
 
         // 开启服务器监听
         void start();
 private:
+        // 在计算线程中执行work 再把结果投递回连接所属的loop
+        template <typename Work, typename Done, typename Result = typename std::result_of<Work()>::type>
+        struct OffloadTask
+        {
+                OffloadTask(const TcpConnectionPtr &c, Work &&w, Done &&d)
+                        : conn(c), work(std::move(w)), done(std::move(d)) {}
+
+                void operator()()
+                {
+                        conn->queueInLoop(std::bind(std::move(done), std::placeholders::_1, work()));
+                }
+
+                TcpConnectionPtr conn;
+                Work work;
+                Done done;
+        };
+
+        template <typename Work, typename Done>
+        struct OffloadTask<Work, Done, void>
+        {
+                OffloadTask(const TcpConnectionPtr &c, Work &&w, Done &&d)
+                        : conn(c), work(std::move(w)), done(std::move(d)) {}
+
+                void operator()()
+                {
+                        work();
+                        conn->queueInLoop(std::bind(std::move(done), std::placeholders::_1));
+                }
+
+                TcpConnectionPtr conn;
+                Work work;
+                Done done;
+        };
+
+        void startLoopAcceptors();
         void newConnection(int sockfd, const InetAddress &peerAddr);
+        void newConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
         void removeConnection(const TcpConnectionPtr &conn);
         void removeConnectionInLoop(const TcpConnectionPtr &conn);
+        void resizeThreadPoolInLoop(int numThreads);
+        void checkRetiringLoops();
 
         using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
+        // 已经从线程池中摘下 等连接迁完后结束的loop
+        struct RetiringLoop
+        {
+                EventLoop *loop;
+                std::unique_ptr<EventLoopThread> thread; // 析构时quit并join loop线程
+        };
+
+        static constexpr double kRetireCheckSeconds = 0.01; // 移除loop时检查连接是否迁完的间隔
+
         EventLoop *loop_; // baseloop 用户定义的loop
 
+        const InetAddress listenAddr_; // 监听地址 每个loop各自创建listenfd时使用
         const std::string ipPort_; // 服务器的ip和端口
         const std::string name_; // 服务器名称
 
         std::unique_ptr<Acceptor> acceptor_; // 运行在mainloop上的acceptor， 任务就是监听新连接事件
+        std::vector<std::unique_ptr<Acceptor>> loopAcceptors_; // 每个subloop上的acceptor 只在per-loop accept模式下使用
         
         std::shared_ptr<EventLoopThreadPool> threadPool_; // 线程池 one loop per thread
+        std::vector<RetiringLoop> retiringLoops_; // 正在移除的loop 只在baseLoop中访问 TcpServer析构时全部join
+        TimerId retireTimer_; // 有正在移除的loop时每kRetireCheckSeconds检查一次 析构时取消
+        std::unique_ptr<ComputePool> computePool_; // 执行offload任务的计算线程池 在loop线程池之前析构
 
         ConnectionCallback connectionCallback_; // 有新连接时的回调
         MessageCallBack messageCallBack_; // 有读写消息时的回调
@@ -72,6 +184,14 @@ private:
 
         std::atomic_int started_;
 
-        int nextConnId_;
+        std::atomic_int nextConnId_;
+        std::mutex connectionsMutex_; // per-loop accept模式下多个loop会同时增删连接
         ConnectionMap connections_; // 保存所有的连接
+
+        double idleTimeout_; // 连接空闲超时秒数
+        size_t zeroCopyThreshold_; // 零拷贝发送的阈值
+        bool corked_; // 新连接是否corked
+        bool edgeTriggered_; // 是否使用ET模式
+        bool reusePort_; // 构造时是否指定了kReusePort
+        AcceptMode acceptMode_; // accept模式
 };
\ No newline at end of file
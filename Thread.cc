@@ -1,5 +1,6 @@
 #include "Thread.h"
 #include "CurrentThread.h"
+#include "CpuTopology.h"
 
 #include <semaphore.h>
 
@@ -32,6 +33,8 @@ void Thread::start()  // 一个Thread对象 就是记录一个线程的详细信
         thread_ = std::shared_ptr<std::thread>(new std::thread([&](){
             // 获取线程的tid值
             tid_ = CurrentThread::tid();
+            // 线程名在perf/top中可见
+            CpuTopology::setCurrentThreadName(name_);
             sem_post(&sem);
             // 开启一个新线程，专门执行该线程函数
             func_(); 
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+
+#include <atomic>
+
+// 定时器 记录回调、超时时刻以及重复间隔 由TimerQueue管理
+class Timer : noncopyable
+{
+public:
+        Timer(TimerCallback cb, Timestamp when, double interval)
+                : callback_(std::move(cb))
+                , expiration_(when)
+                , interval_(interval)
+                , repeat_(interval > 0.0)
+                , sequence_(++s_numCreated_)
+        {}
+
+        void run() const { callback_(); }
+
+        Timestamp expiration() const { return expiration_; }
+        bool repeat() const { return repeat_; }
+        int64_t sequence() const { return sequence_; }
+
+        // 重复定时器在到期后重新计算下一次超时时刻
+        void restart(Timestamp now);
+
+        static int64_t numCreated() { return s_numCreated_; }
+private:
+        const TimerCallback callback_;
+        Timestamp expiration_;
+        const double interval_;  // 重复间隔 单位秒
+        const bool repeat_;
+        const int64_t sequence_; // 全局唯一序号 用来区分地址相同的新旧Timer
+
+        static std::atomic<int64_t> s_numCreated_;
+};
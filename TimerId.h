@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+/*
+ * 定时器的句柄 由runAt/runAfter/runEvery返回 用于EventLoop::cancel
+ * 只保存Timer的地址和序号 可以在任意线程中拷贝、传递和取消
+*/
+class TimerId
+{
+public:
+        TimerId()
+                : timer_(nullptr)
+                , sequence_(0)
+        {}
+
+        TimerId(Timer* timer, int64_t seq)
+                : timer_(timer)
+                , sequence_(seq)
+        {}
+
+        friend class TimerQueue;
+private:
+        Timer* timer_;
+        int64_t sequence_;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+
+#include <set>
+#include <vector>
+#include <atomic>
+
+class EventLoop;
+class Timer;
+class TimerId;
+
+/*
+ * 每个EventLoop拥有一个TimerQueue
+ * 所有定时器共用一个timerfd 由timerfdChannel_注册到loop的Poller上
+ * timerfd只按最早到期的定时器设置超时 到期后一次性取出所有超时的定时器执行
+ * timers_按(到期时间, Timer*)排序 插入、删除都是O(log n)
+*/
+class TimerQueue : noncopyable
+{
+public:
+        explicit TimerQueue(EventLoop* loop);
+        ~TimerQueue();
+
+        // 可以在任意线程调用 定时器回调在loop线程中执行
+        TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+
+        // 可以在任意线程调用
+        void cancel(TimerId timerId);
+private:
+        using Entry = std::pair<Timestamp, Timer*>;
+        using TimerList = std::set<Entry>;
+        using ActiveTimer = std::pair<Timer*, int64_t>;
+        using ActiveTimerSet = std::set<ActiveTimer>;
+
+        void addTimerInLoop(Timer* timer);
+        void cancelInLoop(TimerId timerId);
+        // timerfd可读 有定时器到期了
+        void handleRead();
+        // 取出所有到期的定时器
+        std::vector<Entry> getExpired(Timestamp now);
+        // 重新插入需要重复的定时器 并重设timerfd
+        void reset(const std::vector<Entry>& expired, Timestamp now);
+        // 返回插入的定时器是否成为了最早到期的定时器
+        bool insert(Timer* timer);
+
+        EventLoop* loop_;
+        const int timerfd_;
+        Channel timerfdChannel_;
+        TimerList timers_; // 按到期时间排序
+
+        ActiveTimerSet activeTimers_; // 和timers_保存同样的定时器 按地址排序 用于cancel查找
+        bool callingExpiredTimers_;   // 只在loop线程中访问
+        ActiveTimerSet cancelingTimers_; // 在执行到期回调时被取消的定时器 不能再重复
+};
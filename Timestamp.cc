@@ -2,6 +2,15 @@
 
 #include <time.h>
 
+__thread int64_t Timestamp::t_cachedMicroSeconds_ = 0;
+
+static int64_t readClock(clockid_t clockId)
+{
+        struct timespec ts;
+        ::clock_gettime(clockId, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * Timestamp::kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+}
+
 Timestamp::Timestamp():microSecondsSinceEpoch_(0) {}
 
 Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
@@ -10,20 +19,52 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
 
 Timestamp Timestamp::now()
 {
-        return Timestamp(time(NULL));
+        return Timestamp(readClock(CLOCK_REALTIME));
+}
+
+Timestamp Timestamp::nowCoarse()
+{
+        return Timestamp(readClock(CLOCK_REALTIME_COARSE));
+}
+
+Timestamp Timestamp::monotonic()
+{
+        return Timestamp(readClock(CLOCK_MONOTONIC));
 }
 
 std::string Timestamp::toString() const
+{
+        return toFormattedString(false);
+}
+
+std::string Timestamp::toFormattedString(bool showMicroseconds) const
 {
         char buf[128] = {0};
-        tm *tm_time = localtime(&microSecondsSinceEpoch_);
-        snprintf(buf, 129, "%4d/%02d/%02d %02d:%02d:%02d",
-                tm_time->tm_year + 1900,
-                tm_time->tm_mon + 1,
-                tm_time->tm_mday,
-                tm_time->tm_hour,
-                tm_time->tm_min,
-                tm_time->tm_sec);
+        time_t seconds = static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);
+        tm tm_time;
+        localtime_r(&seconds, &tm_time); // localtime不是线程安全的
+        if (showMicroseconds)
+        {
+                int microseconds = static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond);
+                snprintf(buf, sizeof(buf), "%4d/%02d/%02d %02d:%02d:%02d.%06d",
+                        tm_time.tm_year + 1900,
+                        tm_time.tm_mon + 1,
+                        tm_time.tm_mday,
+                        tm_time.tm_hour,
+                        tm_time.tm_min,
+                        tm_time.tm_sec,
+                        microseconds);
+        }
+        else
+        {
+                snprintf(buf, sizeof(buf), "%4d/%02d/%02d %02d:%02d:%02d",
+                        tm_time.tm_year + 1900,
+                        tm_time.tm_mon + 1,
+                        tm_time.tm_mday,
+                        tm_time.tm_hour,
+                        tm_time.tm_min,
+                        tm_time.tm_sec);
+        }
         return buf;
 }
 
@@ -32,4 +73,4 @@ std::string Timestamp::toString() const
 // {
 //         std::cout << Timestamp::now().toString() << std::endl;
 //         return 0;
-// }
\ No newline at end of file
+// }
@@ -1,16 +1,78 @@
-#pragma once 
+#pragma once
 
 #include <iostream>
 #include <string>
 
-// 时间类
+// 时间类 微秒精度
 class Timestamp
 {
 public:
         Timestamp();
         explicit Timestamp(int64_t microSecondsSinceEpoch_);
+
+        // clock_gettime走vDSO 不陷入内核
+        // 当前时间 CLOCK_REALTIME
         static Timestamp now();
+        // 粗粒度的当前时间 CLOCK_REALTIME_COARSE 精度为一个jiffy(1~4ms) 但比now()更便宜
+        static Timestamp nowCoarse();
+        // 单调时钟 CLOCK_MONOTONIC 起点是开机时刻而不是Epoch 只能用来计算时间间隔
+        static Timestamp monotonic();
+
+        // 当前线程缓存的时间 EventLoop每次poll返回后更新一次
+        // 同一轮循环里的回调和日志都用它 不必各自读时钟 没有EventLoop的线程退化为now()
+        static Timestamp cachedNow()
+        {
+                return t_cachedMicroSeconds_ > 0 ? Timestamp(t_cachedMicroSeconds_) : now();
+        }
+        static void setCachedNow(Timestamp now) { t_cachedMicroSeconds_ = now.microSecondsSinceEpoch_; }
+
+        // 2023/02/28 12:00:00
         std::string toString() const;
+        // 2023/02/28 12:00:00.123456
+        std::string toFormattedString(bool showMicroseconds = true) const;
+
+        int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+        bool valid() const { return microSecondsSinceEpoch_ > 0; }
+
+        static Timestamp invalid() { return Timestamp(); }
+
+        static const int kMicroSecondsPerSecond = 1000 * 1000;
 private:
         int64_t microSecondsSinceEpoch_;
-};
\ No newline at end of file
+
+        static __thread int64_t t_cachedMicroSeconds_;
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+        return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+        return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator!=(Timestamp lhs, Timestamp rhs) { return !(lhs == rhs); }
+inline bool operator>(Timestamp lhs, Timestamp rhs) { return rhs < lhs; }
+inline bool operator<=(Timestamp lhs, Timestamp rhs) { return !(rhs < lhs); }
+inline bool operator>=(Timestamp lhs, Timestamp rhs) { return !(lhs < rhs); }
+
+// 两个时间点相差的微秒数
+inline int64_t operator-(Timestamp high, Timestamp low)
+{
+        return high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+}
+
+// 两个时间点相差的秒数
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+        return static_cast<double>(high - low) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 在timestamp的基础上增加seconds秒，定时器计算超时时刻时使用
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+        int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+        return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
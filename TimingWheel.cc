@@ -0,0 +1,185 @@
+#include "TimingWheel.h"
+
+#include <math.h>
+
+TimingWheel::Entry::Entry(ExpireCallback cb)
+        : expire_(0)
+        , wheel_(nullptr)
+        , callback_(std::move(cb))
+{
+        prev = nullptr;
+        next = nullptr;
+}
+
+TimingWheel::Entry::~Entry()
+{
+        if (linked())
+        {
+                wheel_->remove(this);
+        }
+}
+
+TimingWheel::TimingWheel(double tickSeconds)
+        : tickSeconds_(tickSeconds)
+        , current_(0)
+        , size_(0)
+{
+        for (int level = 0; level < kLevels; ++level)
+        {
+                for (int slot = 0; slot < kSlots; ++slot)
+                {
+                        wheels_[level][slot].prev = &wheels_[level][slot];
+                        wheels_[level][slot].next = &wheels_[level][slot];
+                }
+        }
+}
+
+TimingWheel::~TimingWheel()
+{
+        // 把剩下的节点全部摘下来 防止节点析构时访问已经销毁的时间轮
+        for (int level = 0; level < kLevels; ++level)
+        {
+                for (int slot = 0; slot < kSlots; ++slot)
+                {
+                        Link* head = &wheels_[level][slot];
+                        while (head->next != head)
+                        {
+                                unlink(head->next);
+                        }
+                }
+        }
+}
+
+void TimingWheel::add(Entry* entry, double seconds)
+{
+        uint64_t ticks = static_cast<uint64_t>(ceil(seconds / tickSeconds_));
+        if (ticks == 0)
+        {
+                ticks = 1;
+        }
+        uint64_t expire = current_ + ticks;
+
+        if (entry->linked())
+        {
+                if (entry->wheel_ == this && entry->expire_ == expire)
+                {
+                        return; // 同一个tick内的多次touch 不需要移动
+                }
+                entry->wheel_->remove(entry);
+        }
+
+        entry->expire_ = expire;
+        entry->wheel_ = this;
+        place(entry);
+        ++size_;
+}
+
+void TimingWheel::remove(Entry* entry)
+{
+        if (entry->linked())
+        {
+                unlink(entry);
+                --size_;
+        }
+}
+
+void TimingWheel::advance()
+{
+        ++current_;
+
+        // 低层转满一圈时 把上一层当前槽的节点分配到下层
+        for (int level = 1; level < kLevels; ++level)
+        {
+                uint64_t lowerMask = (1ULL << (kSlotBits * level)) - 1;
+                if ((current_ & lowerMask) != 0)
+                {
+                        break;
+                }
+                cascade(level, static_cast<int>((current_ >> (kSlotBits * level)) & kSlotMask));
+        }
+
+        // 先把到期的槽整体摘到局部链表上 回调中可能会add/remove其他节点
+        Link* head = &wheels_[0][current_ & kSlotMask];
+        if (head->next == head)
+        {
+                return;
+        }
+        Link expired;
+        expired.prev = head->prev;
+        expired.next = head->next;
+        expired.prev->next = &expired;
+        expired.next->prev = &expired;
+        head->prev = head;
+        head->next = head;
+
+        while (expired.next != &expired)
+        {
+                Entry* entry = static_cast<Entry*>(expired.next);
+                unlink(entry);
+                --size_;
+                if (entry->callback_)
+                {
+                        entry->callback_();
+                }
+        }
+}
+
+void TimingWheel::place(Entry* entry)
+{
+        uint64_t delta = entry->expire_ > current_ ? entry->expire_ - current_ : 0;
+        if (delta >= kMaxTicks)
+        {
+                delta = kMaxTicks - 1;
+                entry->expire_ = current_ + delta;
+        }
+
+        int level = 0;
+        while (level < kLevels - 1 && delta >= (1ULL << (kSlotBits * (level + 1))))
+        {
+                ++level;
+        }
+        // delta为0说明节点已经到期 放到当前槽上 随后的advance会执行它
+        uint64_t tick = delta == 0 ? current_ : entry->expire_;
+        int slot = static_cast<int>((tick >> (kSlotBits * level)) & kSlotMask);
+        linkTail(&wheels_[level][slot], entry);
+}
+
+void TimingWheel::cascade(int level, int slot)
+{
+        Link* head = &wheels_[level][slot];
+        Link pending;
+        pending.prev = &pending;
+        pending.next = &pending;
+        if (head->next != head)
+        {
+                pending.prev = head->prev;
+                pending.next = head->next;
+                pending.prev->next = &pending;
+                pending.next->prev = &pending;
+                head->prev = head;
+                head->next = head;
+        }
+
+        while (pending.next != &pending)
+        {
+                Entry* entry = static_cast<Entry*>(pending.next);
+                unlink(entry);
+                place(entry);
+        }
+}
+
+void TimingWheel::linkTail(Link* head, Link* node)
+{
+        node->prev = head->prev;
+        node->next = head;
+        head->prev->next = node;
+        head->prev = node;
+}
+
+void TimingWheel::unlink(Link* node)
+{
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = nullptr;
+        node->next = nullptr;
+}
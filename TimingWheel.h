@@ -0,0 +1,78 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <functional>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 分层时间轮 用于海量连接的空闲超时、心跳超时
+ * 共kLevels层 每层kSlots个槽 第0层每个槽代表一个tick 第n层每个槽代表kSlots^n个tick
+ * 节点是侵入式双向链表 add/touch/remove都是O(1) 不分配内存
+ * 时间轮不自己计时 由所属loop的定时器每个tick调用一次advance()
+ * 只能在所属loop线程中使用
+*/
+class TimingWheel : noncopyable
+{
+public:
+        using ExpireCallback = std::function<void()>;
+
+        struct Link
+        {
+                Link* prev;
+                Link* next;
+        };
+
+        // 挂在时间轮上的节点 由使用者持有（例如TcpConnection） 析构时自动从时间轮上摘除
+        class Entry : noncopyable, private Link
+        {
+        public:
+                explicit Entry(ExpireCallback cb = ExpireCallback());
+                ~Entry();
+
+                void setCallback(ExpireCallback cb) { callback_ = std::move(cb); }
+                bool linked() const { return prev != nullptr; }
+        private:
+                friend class TimingWheel;
+
+                uint64_t expire_;     // 到期的tick
+                TimingWheel* wheel_;  // 当前挂在哪个时间轮上
+                ExpireCallback callback_;
+        };
+
+        explicit TimingWheel(double tickSeconds);
+        ~TimingWheel();
+
+        // seconds秒之后到期 向上取整到tick 已经在时间轮上的节点会被重新挂载
+        void add(Entry* entry, double seconds);
+        // 重新计时 等价于add 到期tick不变时什么都不做
+        void touch(Entry* entry, double seconds) { add(entry, seconds); }
+        void remove(Entry* entry);
+
+        // 前进一个tick 执行所有到期节点的回调
+        void advance();
+
+        double tickSeconds() const { return tickSeconds_; }
+        uint64_t currentTick() const { return current_; }
+        size_t size() const { return size_; }
+private:
+        static const int kSlotBits = 6;
+        static const int kSlots = 1 << kSlotBits;
+        static const int kSlotMask = kSlots - 1;
+        static const int kLevels = 4;
+        static const uint64_t kMaxTicks = 1ULL << (kSlotBits * kLevels);
+
+        // 根据剩余tick数把节点挂到对应层的槽上
+        void place(Entry* entry);
+        // 把第level层slot槽上的节点重新分配到下层
+        void cascade(int level, int slot);
+
+        static void linkTail(Link* head, Link* node);
+        static void unlink(Link* node);
+
+        const double tickSeconds_;
+        uint64_t current_;
+        size_t size_;
+        Link wheels_[kLevels][kSlots]; // 每个槽都是双向循环链表的哨兵节点
+};
@@ -0,0 +1,204 @@
+#include <HCNL/TcpServer.h>
+#include <HCNL/Logger.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+/*
+ * 证明TcpConnection和TcpServer投递任务的路径不分配内存
+ * 替换全局operator new 只统计打开了计数的线程 也就是投递任务的线程
+ * 在一个真实的连接上从非loop线程调用send/shutdown等接口 再按TcpServer投递的闭包形状向loop投递
+ * 有分配时返回非0 ctest以此判断
+ * 用法: alloctest [port]
+*/
+
+static thread_local bool t_counting = false;
+static std::atomic<long> g_allocs(0);
+
+void* operator new(size_t n)
+{
+        if (t_counting)
+        {
+                g_allocs.fetch_add(1, std::memory_order_relaxed);
+        }
+        void* p = malloc(n == 0 ? 1 : n);
+        if (p == nullptr)
+        {
+                throw std::bad_alloc();
+        }
+        return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// 每批投递的任务数 小于EventLoop任务队列的环形容量 不会退到加锁的溢出vector
+static const int kBatch = 256;
+static const int kRounds = 200;
+
+// 和TcpServer::removeConnectionInLoop同样形状的闭包: bind(成员函数, 对象指针, TcpConnectionPtr)
+struct Probe
+{
+        Probe() : executed(0) {}
+        void touch(const TcpConnectionPtr&) { executed.fetch_add(1, std::memory_order_relaxed); }
+        void mark() { executed.fetch_add(1, std::memory_order_relaxed); }
+        std::atomic<long> executed;
+};
+
+static int connectTo(uint16_t port)
+{
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        for (int i = 0; i < 100; ++i)
+        {
+                if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+                {
+                        return fd;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        perror("connect");
+        exit(2);
+}
+
+// 等loop执行完投递给它的一个标记任务 之前投递的任务都已经执行
+static void waitFor(const Probe& probe, long expected)
+{
+        while (probe.executed.load(std::memory_order_relaxed) < expected)
+        {
+                std::this_thread::yield();
+        }
+}
+
+static int check(const char* what, long allocs)
+{
+        printf("%-48s allocations: %ld\n", what, allocs);
+        return allocs == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+        uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 9977;
+        int failures = 0;
+
+        // 空的std::function构造出空Task
+        {
+                Task empty{std::function<void()>()};
+                void (*nullFn)() = nullptr;
+                Task emptyFn(nullFn);
+                if (empty || emptyFn)
+                {
+                        printf("Task built from an empty callable is not null\n");
+                        ++failures;
+                }
+        }
+
+        // 库里投递的闭包都要放得进Task内部
+        static_assert(Task::fitsInline<decltype(std::bind(&TcpConnection::connectEstablished,
+                std::declval<TcpConnectionPtr>()))>(), "TcpServer::newConnection");
+        static_assert(Task::fitsInline<decltype(std::bind(&Probe::touch,
+                std::declval<Probe*>(), std::declval<TcpConnectionPtr>()))>(), "TcpServer::removeConnection");
+
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), "alloctest");
+        server.setThreadNum(1);
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        TcpConnectionPtr conn;
+        server.setConnectionCallback([&](const TcpConnectionPtr& c)
+                {
+                        if (c->connected())
+                        {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                conn = c;
+                                cond.notify_one();
+                        }
+                });
+        server.setMessageCallback([](const TcpConnectionPtr&, Buffer* buf, Timestamp) { buf->retrieveAll(); });
+        server.start();
+
+        std::thread test([&]()
+                {
+                        int fd = connectTo(port);
+                        // 把服务器发来的数据读掉 连接的输出缓冲区不会积压
+                        std::thread drain([fd]()
+                                {
+                                        char buf[64 * 1024];
+                                        while (::read(fd, buf, sizeof(buf)) > 0)
+                                        {
+                                        }
+                                });
+                        {
+                                std::unique_lock<std::mutex> lock(mutex);
+                                cond.wait(lock, [&]() { return conn != nullptr; });
+                        }
+                        EventLoop* ioLoop = conn->getLoop();
+                        Probe probe;
+                        long expected = 0;
+                        const std::string message("ping");
+
+                        // 第一轮只用来预热 各个队列和缓冲区长到稳定的容量
+                        for (int round = 0; round <= kRounds; ++round)
+                        {
+                                bool counting = round > 0;
+                                t_counting = counting;
+                                for (int i = 0; i < kBatch; ++i)
+                                {
+                                        // TcpConnection: 非loop线程调用的接口经过Routed投递
+                                        conn->send(message);
+                                        conn->send(std::string("pong"));
+                                        conn->queueInLoop(std::bind(&TcpConnection::connected, std::placeholders::_1));
+                                        // TcpServer: connectEstablished和removeConnectionInLoop的形状
+                                        ioLoop->runInLoop(std::bind(&TcpConnection::connected, conn));
+                                        loop.runInLoop(std::bind(&Probe::touch, &probe, conn));
+                                }
+                                expected += kBatch;
+                                t_counting = false;
+                                ioLoop->queueInLoop(std::bind(&Probe::mark, &probe));
+                                ++expected;
+                                waitFor(probe, expected);
+                                if (!counting)
+                                {
+                                        g_allocs.store(0);
+                                }
+                        }
+                        long postAllocs = g_allocs.exchange(0);
+
+                        t_counting = true;
+                        conn->shutdown();
+                        t_counting = false;
+                        long shutdownAllocs = g_allocs.exchange(0);
+
+                        failures += check("send/queueInLoop/runInLoop posts", postAllocs);
+                        failures += check("shutdown", shutdownAllocs);
+                        printf("%d rounds x %d iterations, 5 posts each\n", kRounds, kBatch);
+
+                        drain.join();
+                        ::close(fd);
+                        conn.reset();
+                        loop.quit();
+                });
+        loop.loop();
+        test.join();
+
+        printf(failures == 0 ? "PASS\n" : "FAIL\n");
+        return failures;
+}
@@ -0,0 +1,170 @@
+#include <HCNL/TcpServer.h>
+#include <HCNL/Coroutine.h>
+#include <HCNL/Logger.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+/*
+ * 协程接口的检查 需要cmake -DHCNL_CXX20=ON
+ * 每个连接一个协程: 按行读 睡一会 原样写回 最后一个连接的协程睡很久 loop退出时还没醒
+ * 检查回显正确 以及loop退出后所有协程帧（和帧里持有的连接）都已经销毁
+ * 有错误时返回非0 ctest以此判断
+ * 用法: coecho [port]
+*/
+
+static const int kClients = 4;
+static const int kLines = 50;
+
+static std::atomic<int> g_liveSessions(0);
+
+// 协程帧销毁时计数减一 不管协程是自己结束还是被销毁
+struct SessionGuard
+{
+        SessionGuard() { ++g_liveSessions; }
+        ~SessionGuard() { --g_liveSessions; }
+};
+
+static CoTask echo(TcpConnectionPtr conn)
+{
+        SessionGuard guard;
+        for (;;)
+        {
+                std::string line = co_await conn->readUntil("\r\n");
+                if (line.empty())
+                {
+                        co_return;
+                }
+                if (line == "SLEEP\r\n")
+                {
+                        // 远超过loop运行的时间 协程只能在loop退出时随定时器销毁
+                        co_await conn->getLoop()->sleep(3600.0);
+                        co_return;
+                }
+                co_await conn->getLoop()->sleep(0.001);
+                if (!co_await conn->write(std::move(line)))
+                {
+                        co_return;
+                }
+        }
+}
+
+static int connectTo(uint16_t port)
+{
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        for (int i = 0; i < 100; ++i)
+        {
+                if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+                {
+                        // 半行半行地写 关掉Nagle 不等延迟确认
+                        int one = 1;
+                        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                        return fd;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        perror("connect");
+        exit(2);
+}
+
+// 每行分两次写 协程要跨多次读事件拼出一行
+static bool echoLine(int fd, const std::string& line)
+{
+        size_t half = line.size() / 2;
+        if (::write(fd, line.data(), half) != static_cast<ssize_t>(half))
+        {
+                return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        if (::write(fd, line.data() + half, line.size() - half) != static_cast<ssize_t>(line.size() - half))
+        {
+                return false;
+        }
+        std::string reply(line.size(), '\0');
+        size_t got = 0;
+        while (got < reply.size())
+        {
+                ssize_t n = ::read(fd, &reply[got], reply.size() - got);
+                if (n <= 0)
+                {
+                        return false;
+                }
+                got += n;
+        }
+        return reply == line;
+}
+
+int main(int argc, char* argv[])
+{
+        uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 9988;
+        int failures = 0;
+        int sleeper = -1;
+
+        {
+                EventLoop loop;
+                TcpServer server(&loop, InetAddress(port), "coecho");
+                server.setThreadNum(2);
+                server.setConnectionCallback([](const TcpConnectionPtr& conn)
+                        {
+                                if (conn->connected())
+                                {
+                                        echo(conn);
+                                }
+                        });
+                server.start();
+
+                std::thread client([&]()
+                        {
+                                for (int c = 0; c < kClients; ++c)
+                                {
+                                        int fd = connectTo(port);
+                                        for (int i = 0; i < kLines; ++i)
+                                        {
+                                                if (!echoLine(fd, "hello " + std::to_string(c) + " " + std::to_string(i) + "\r\n"))
+                                                {
+                                                        ++failures;
+                                                        break;
+                                                }
+                                        }
+                                        ::close(fd);
+                                }
+                                // 这个连接保持打开 协程停在长时间的sleep上
+                                sleeper = connectTo(port);
+                                if (::write(sleeper, "SLEEP\r\n", 7) != 7)
+                                {
+                                        ++failures;
+                                }
+                                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                                loop.quit();
+                        });
+                loop.loop();
+                client.join();
+        }
+        // server和各个subloop都已经析构 睡着的协程应当随定时器一起销毁
+        int live = g_liveSessions.load();
+        printf("echo failures: %d, coroutine frames alive after the loops quit: %d\n", failures, live);
+        if (live != 0)
+        {
+                ++failures;
+        }
+        ::close(sleeper);
+
+        printf(failures == 0 ? "PASS\n" : "FAIL\n");
+        return failures;
+}
@@ -0,0 +1,263 @@
+#include <HCNL/TcpServer.h>
+#include <HCNL/EventLoopThreadPool.h>
+#include <HCNL/Logger.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * 水平触发(LT)和边缘触发(ET)的对比
+ * bulk:  若干客户端各自往丢弃服务器灌大量数据 看吞吐和loop轮数/读回调次数
+ * small: 大量客户端各自做小消息的一问一答 看吞吐和延迟
+ * 用法: etbench [port] [bulkMBPerClient] [roundTripsPerClient]
+*/
+
+using Clock = std::chrono::steady_clock;
+
+static const int kServerThreads = 2;
+static const int kBulkClients = 4;
+static const int kSmallClients = 32;
+static const size_t kSmallMessage = 64;
+
+static int connectTo(uint16_t port)
+{
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        // 服务器在另一个线程中启动 连不上就重试
+        for (int i = 0; i < 100; ++i)
+        {
+                if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+                {
+                        int one = 1;
+                        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                        return fd;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        perror("connect");
+        exit(1);
+}
+
+static bool writeAll(int fd, const char* data, size_t len)
+{
+        while (len > 0)
+        {
+                ssize_t n = ::write(fd, data, len);
+                if (n <= 0)
+                {
+                        return false;
+                }
+                data += n;
+                len -= n;
+        }
+        return true;
+}
+
+static bool readAll(int fd, char* data, size_t len)
+{
+        while (len > 0)
+        {
+                ssize_t n = ::read(fd, data, len);
+                if (n <= 0)
+                {
+                        return false;
+                }
+                data += n;
+                len -= n;
+        }
+        return true;
+}
+
+struct Result
+{
+        double seconds;
+        uint64_t iterations; // 所有subloop的循环轮数
+        uint64_t events;     // 所有subloop处理的IO事件数
+        long callbacks;      // 服务器MessageCallBack被调用的次数
+        std::vector<int64_t> latencies; // small: 每次一问一答的微秒数
+};
+
+// 在当前线程运行一个服务器 workload在另一个线程中跑完后退出loop
+template <typename Workload>
+static Result runServer(uint16_t port, bool et, bool discard, Workload workload)
+{
+        Result result;
+        result.callbacks = 0;
+        std::atomic<long> callbacks(0);
+
+        EventLoop loop;
+        InetAddress addr(port);
+        TcpServer server(&loop, addr, et ? "etbench-ET" : "etbench-LT");
+        server.setThreadNum(kServerThreads);
+        server.setEdgeTriggered(et);
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setMessageCallback(
+                [&callbacks, discard](const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+                {
+                        callbacks.fetch_add(1, std::memory_order_relaxed);
+                        if (discard)
+                        {
+                                buf->retrieveAll();
+                        }
+                        else
+                        {
+                                conn->send(buf->retrieveAllAsString());
+                        }
+                });
+        server.start();
+
+        std::thread client([&]()
+                {
+                        Clock::time_point start = Clock::now();
+                        workload(port, &result);
+                        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                        loop.quit();
+                });
+        loop.loop();
+        client.join();
+
+        result.iterations = 0;
+        result.events = 0;
+        for (const EventLoopMetrics::Snapshot& s : server.threadPool()->metricsSnapshot())
+        {
+                result.iterations += s.iterations;
+                result.events += s.events;
+        }
+        result.callbacks = callbacks.load();
+        return result;
+}
+
+// 每个客户端写完bytes字节后半关闭 等服务器读完关掉连接
+static void bulkWorkload(uint16_t port, size_t bytes, Result*)
+{
+        std::vector<std::thread> clients;
+        for (int i = 0; i < kBulkClients; ++i)
+        {
+                clients.emplace_back([port, bytes]()
+                        {
+                                int fd = connectTo(port);
+                                std::string chunk(256 * 1024, 'x');
+                                size_t left = bytes;
+                                while (left > 0)
+                                {
+                                        size_t n = std::min(left, chunk.size());
+                                        if (!writeAll(fd, chunk.data(), n))
+                                        {
+                                                break;
+                                        }
+                                        left -= n;
+                                }
+                                ::shutdown(fd, SHUT_WR);
+                                char c;
+                                while (::read(fd, &c, 1) > 0)
+                                {
+                                }
+                                ::close(fd);
+                        });
+        }
+        for (std::thread& t : clients)
+        {
+                t.join();
+        }
+}
+
+// 每个客户端做roundTrips次kSmallMessage字节的一问一答
+static void smallWorkload(uint16_t port, int roundTrips, Result* result)
+{
+        std::vector<std::vector<int64_t>> latencies(kSmallClients);
+        std::vector<std::thread> clients;
+        for (int i = 0; i < kSmallClients; ++i)
+        {
+                clients.emplace_back([port, roundTrips, i, &latencies]()
+                        {
+                                int fd = connectTo(port);
+                                char out[kSmallMessage];
+                                char in[kSmallMessage];
+                                memset(out, 'a' + i % 26, sizeof(out));
+                                latencies[i].reserve(roundTrips);
+                                for (int r = 0; r < roundTrips; ++r)
+                                {
+                                        Clock::time_point start = Clock::now();
+                                        if (!writeAll(fd, out, sizeof(out)) || !readAll(fd, in, sizeof(in)))
+                                        {
+                                                break;
+                                        }
+                                        latencies[i].push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                Clock::now() - start).count());
+                                }
+                                ::close(fd);
+                        });
+        }
+        for (std::thread& t : clients)
+        {
+                t.join();
+        }
+        for (std::vector<int64_t>& l : latencies)
+        {
+                result->latencies.insert(result->latencies.end(), l.begin(), l.end());
+        }
+}
+
+static int64_t percentile(std::vector<int64_t>& values, double p)
+{
+        if (values.empty())
+        {
+                return 0;
+        }
+        size_t index = static_cast<size_t>(p / 100.0 * (values.size() - 1));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+}
+
+int main(int argc, char* argv[])
+{
+        uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 9100;
+        size_t bulkBytes = (argc > 2 ? atol(argv[2]) : 256) * 1024 * 1024;
+        int roundTrips = argc > 3 ? atoi(argv[3]) : 5000;
+
+        // 连接日志很多 结果最后一起输出
+        std::string report;
+        char line[256];
+        for (int et = 0; et <= 1; ++et)
+        {
+                Result r = runServer(port++, et, true,
+                        [bulkBytes](uint16_t p, Result* res) { bulkWorkload(p, bulkBytes, res); });
+                double mb = static_cast<double>(bulkBytes) * kBulkClients / (1024 * 1024);
+                snprintf(line, sizeof(line), "bulk  %s: %d clients x %zu MB in %.3f s = %.1f MB/s, loop iterations %lu, events %lu, read callbacks %ld\n",
+                        et ? "ET" : "LT", kBulkClients, bulkBytes / (1024 * 1024), r.seconds, mb / r.seconds,
+                        (unsigned long)r.iterations, (unsigned long)r.events, r.callbacks);
+                report += line;
+        }
+
+        for (int et = 0; et <= 1; ++et)
+        {
+                Result r = runServer(port++, et, false,
+                        [roundTrips](uint16_t p, Result* res) { smallWorkload(p, roundTrips, res); });
+                size_t total = r.latencies.size();
+                int64_t p50 = percentile(r.latencies, 50);
+                int64_t p99 = percentile(r.latencies, 99);
+                snprintf(line, sizeof(line), "small %s: %d clients x %d round trips of %zu bytes in %.3f s = %.0f msg/s, p50 %ld us, p99 %ld us, loop iterations %lu\n",
+                        et ? "ET" : "LT", kSmallClients, roundTrips, kSmallMessage, r.seconds, total / r.seconds,
+                        (long)p50, (long)p99, (unsigned long)r.iterations);
+                report += line;
+        }
+        printf("\n%s", report.c_str());
+        return 0;
+}
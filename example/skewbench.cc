@@ -0,0 +1,193 @@
+#include <HCNL/TcpServer.h>
+#include <HCNL/EventLoopThreadPool.h>
+#include <HCNL/Logger.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * 负载不均时各个subloop选择策略的尾延迟对比
+ * 4个长连接的重客户端（每条消息在loop线程上阻塞1ms）和短连接交替到达
+ * 之后8个轻客户端做1字节的一问一答 统计它们的往返延迟
+ * 轮询会把重连接都放到同一个loop上 和它们同loop的轻连接被队头阻塞
+ * 用法: skewbench [port]
+*/
+
+using Clock = std::chrono::steady_clock;
+
+static const int kServerThreads = 4;
+static const int kHeavyClients = 4;
+static const int kShortPerHeavy = 3;
+static const int kLightClients = 8;
+static const int kLightRoundTrips = 200;
+static const int kHeavyWorkMicros = 1000;
+
+static int64_t nowMicros()
+{
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static void sleepMillis(int ms)
+{
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static int connectTo(uint16_t port)
+{
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        for (int i = 0; i < 100; ++i)
+        {
+                if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+                {
+                        int one = 1;
+                        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                        return fd;
+                }
+                sleepMillis(10);
+        }
+        perror("connect");
+        exit(1);
+}
+
+// 发一个字节等一个字节的回复
+static bool roundTrip(int fd, char c)
+{
+        return ::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1;
+}
+
+static int64_t percentile(const std::vector<int64_t>& sorted, double p)
+{
+        return sorted.empty() ? 0 : sorted[static_cast<size_t>(p / 100.0 * (sorted.size() - 1))];
+}
+
+static std::string runStrategy(uint16_t port, LoopSelector::Strategy strategy, const char* name)
+{
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), name);
+        server.setThreadNum(kServerThreads);
+        server.setLoopSelection(strategy);
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setMessageCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+                {
+                        std::string msg(buf->retrieveAllAsString());
+                        if (!msg.empty() && msg[0] == 'H')
+                        {
+                                // 重请求在loop线程上阻塞 模拟耗时的处理
+                                ::usleep(kHeavyWorkMicros);
+                        }
+                        conn->send(std::string(msg.size(), 'r'));
+                });
+        server.start();
+
+        std::string report;
+        std::thread client([&]()
+                {
+                        std::atomic<bool> stop(false);
+                        std::vector<std::thread> heavies;
+                        for (int h = 0; h < kHeavyClients; ++h)
+                        {
+                                int fd = connectTo(port);
+                                heavies.emplace_back([fd, &stop]()
+                                        {
+                                                while (!stop && roundTrip(fd, 'H'))
+                                                {
+                                                }
+                                                ::close(fd);
+                                        });
+                                // 夹在重连接之间的短连接 让轮询恰好把重连接都放到同一个loop上
+                                for (int s = 0; s < kShortPerHeavy; ++s)
+                                {
+                                        int sfd = connectTo(port);
+                                        sleepMillis(5);
+                                        ::close(sfd);
+                                        sleepMillis(20);
+                                }
+                        }
+                        sleepMillis(200);
+
+                        std::mutex mutex;
+                        std::vector<int64_t> latencies;
+                        std::vector<std::thread> lights;
+                        for (int l = 0; l < kLightClients; ++l)
+                        {
+                                int fd = connectTo(port);
+                                sleepMillis(10);
+                                lights.emplace_back([fd, &mutex, &latencies]()
+                                        {
+                                                std::vector<int64_t> mine;
+                                                for (int i = 0; i < kLightRoundTrips; ++i)
+                                                {
+                                                        int64_t start = nowMicros();
+                                                        if (!roundTrip(fd, 'L'))
+                                                        {
+                                                                break;
+                                                        }
+                                                        mine.push_back(nowMicros() - start);
+                                                        sleepMillis(2);
+                                                }
+                                                ::close(fd);
+                                                std::lock_guard<std::mutex> lock(mutex);
+                                                latencies.insert(latencies.end(), mine.begin(), mine.end());
+                                        });
+                        }
+
+                        std::string counts;
+                        for (EventLoop* ioLoop : server.threadPool()->getAllLoops())
+                        {
+                                counts += (counts.empty() ? "" : "/") + std::to_string(ioLoop->numConnections());
+                        }
+                        for (std::thread& t : lights)
+                        {
+                                t.join();
+                        }
+                        stop = true;
+                        for (std::thread& t : heavies)
+                        {
+                                t.join();
+                        }
+
+                        std::sort(latencies.begin(), latencies.end());
+                        char line[256];
+                        snprintf(line, sizeof(line), "%-12s conns/loop %-10s light rtt p50 %5ld us  p90 %5ld us  p99 %5ld us\n",
+                                name, counts.c_str(), (long)percentile(latencies, 50), (long)percentile(latencies, 90),
+                                (long)percentile(latencies, 99));
+                        report = line;
+                        loop.quit();
+                });
+        loop.loop();
+        client.join();
+        return report;
+}
+
+int main(int argc, char* argv[])
+{
+        uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 9200;
+
+        // 连接日志很多 结果最后一起输出
+        std::string report;
+        report += runStrategy(port++, LoopSelector::kRoundRobin, "round-robin");
+        report += runStrategy(port++, LoopSelector::kLeastConnections, "least-conn");
+        report += runStrategy(port++, LoopSelector::kPowerOfTwoChoices, "p2c");
+        report += runStrategy(port++, LoopSelector::kPeerHash, "peer-hash");
+        printf("\n%s", report.c_str());
+        return 0;
+}